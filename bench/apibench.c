@@ -0,0 +1,196 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "forth.h"
+
+
+// Embedding API microbenchmarks: every sample times a batch of calls, and
+// throughput and per-call latency percentiles are computed over the samples.
+
+#define SAMPLES_MAX	100000
+
+typedef void (*bench_f)(int batch);
+
+static long long samples[SAMPLES_MAX];
+static int warmup = 100, repeat = 1000;
+static const char *imgname = "apibench.img";
+static int noop_xt, gen_handle;
+
+
+static int cmp(const void *a, const void *b)
+{
+	long long x = *(const long long *)a, y = *(const long long *)b;
+	
+	return x < y ? -1 : x > y;
+}
+
+
+static void run(const char *name, bench_f f, int batch, int reps)
+{
+	long long total = 0, t;
+	int i;
+	
+	if (reps > SAMPLES_MAX)
+		reps = SAMPLES_MAX;
+	
+	for (i = 0; i < warmup; i++)
+		f(batch);
+	
+	for (i = 0; i < reps; i++) {
+		t = fth_nanotime();
+		f(batch);
+		samples[i] = fth_nanotime() - t;
+		total += samples[i];
+	}
+	
+	qsort(samples, reps, sizeof(long long), cmp);
+	printf("%-20s %8d %8d %14.0f %10.1f %10.1f\n", name, reps, batch,
+		total ? (double)reps * batch * 1e9 / total : 0.0,
+		(double)samples[reps / 2] / batch,
+		(double)samples[reps * 99 / 100] / batch);
+}
+
+
+// ================================ Benchmarks =================================
+
+static void initfree(int batch)
+{
+	int i;
+	
+	for (i = 0; i < batch; i++) {
+		fth_free();
+		fth_init(NULL, NULL);
+	}
+}
+
+
+static void interpret(int batch)
+{
+	int i;
+	
+	for (i = 0; i < batch; i++)
+		fth_interpret("1 2 + DUP * DROP");
+}
+
+
+static void execute(int batch)
+{
+	int i;
+	
+	for (i = 0; i < batch; i++)
+		fth_execute("NOOP");
+}
+
+
+static void call(int batch)
+{
+	int i;
+	
+	for (i = 0; i < batch; i++)
+		fth_call(noop_xt, NULL, 0, NULL, 0);
+}
+
+
+static void pushpop(int batch)
+{
+	int i;
+	
+	for (i = 0; i < batch; i++) {
+		fth_push(i);
+		fth_pop();
+	}
+}
+
+
+static void area(int batch)
+{
+	int a = 1, i;
+	volatile char c;
+	
+	for (i = 0; i < batch; i++)
+		c = *fth_area(a + (i & 255), 16);
+	(void)c;
+}
+
+
+static void restore(int batch)
+{
+	int i;
+	
+	for (i = 0; i < batch; i++) {
+		fth_store(1 + (i & 63) * 4, i);
+		fth_restore();
+	}
+}
+
+
+static void resume(int batch)
+{
+	int i;
+	
+	for (i = 0; i < batch; i++)
+		fth_resume(gen_handle, 0);
+}
+
+
+static void savesystem(int batch)
+{
+	int i;
+	
+	for (i = 0; i < batch; i++)
+		fth_savesystem(imgname);
+}
+
+
+static void loadsystem(int batch)
+{
+	int i;
+	
+	for (i = 0; i < batch; i++)
+		fth_loadsystem(imgname);
+}
+
+
+int main(int argc, char *argv[])
+{
+	int i;
+	
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+			warmup = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+			repeat = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+			imgname = argv[++i];
+		} else {
+			fprintf(stderr, "Usage: %s [-w warmup] [-n samples] [-f image file]\n", argv[0]);
+			return 1;
+		}
+	}
+	
+	fth_init(NULL, NULL);
+	if (!fth_interpret(": NOOP ; : GEN BEGIN YIELD AGAIN ; 300 ALLOT") || !(noop_xt = fth_lookup("NOOP"))) {
+		fprintf(stderr, "Error: %s\n", fth_geterror());
+		return 1;
+	}
+	
+	printf("%-20s %8s %8s %14s %10s %10s\n", "benchmark", "samples", "batch", "calls/s", "p50, ns", "p99, ns");
+	run("fth_push/fth_pop", pushpop, 1000, repeat);
+	run("fth_area", area, 1000, repeat);
+	run("fth_call", call, 100, repeat);
+	run("fth_execute", execute, 100, repeat);
+	run("fth_interpret", interpret, 10, repeat);
+	gen_handle = fth_start(fth_lookup("GEN"), NULL, 0);
+	run("fth_resume", resume, 100, repeat);
+	fth_discard(gen_handle);
+	fth_checkpoint();
+	run("fth_restore", restore, 100, repeat);
+	run("fth_savesystem", savesystem, 1, repeat / 10 + 1);
+	run("fth_loadsystem", loadsystem, 1, repeat / 10 + 1);
+	run("fth_init/fth_free", initfree, 1, repeat / 10 + 1);
+	
+	fth_free();
+	remove(imgname);
+	return 0;
+}
@@ -0,0 +1,22 @@
+\ Bubble sort of a reversed array: @/! and nested DO LOOPs
+
+1000 CONSTANT N
+CREATE ARR N CELLS ALLOT
+
+: FILL-REVERSED N 0 DO N I - ARR I CELLS + ! LOOP ;
+
+: SORT
+	N 1 DO
+		N I - 0 DO
+			ARR I CELLS + DUP @ OVER CELL+ @ 2DUP > IF
+				ROT TUCK ! CELL+ !
+			ELSE
+				2DROP DROP
+			THEN
+		LOOP
+	LOOP ;
+
+: BUBBLE 3 0 DO FILL-REVERSED SORT LOOP ;
+
+BUBBLE
+BYE
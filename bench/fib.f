@@ -0,0 +1,13 @@
+\ Recursive Fibonacci: ENTER/EXIT, EXECUTE and IF-heavy threaded code
+\ (the word being defined is hidden until ; so recursion goes through a VALUE)
+
+VALUE 'FIB
+
+: FIB ( n -- fib )
+	DUP 2 < IF EXIT THEN
+	DUP 1- 'FIB EXECUTE SWAP 2 - 'FIB EXECUTE + ;
+
+' FIB TO 'FIB
+
+30 FIB . CR
+BYE
@@ -0,0 +1,100 @@
+#!/bin/sh
+# Runs benchmark programs and prints "name seconds" lines, best of several runs.
+# With -c compares the timings with a baseline file of the same format and
+# exits with status 1 if any benchmark is slower by more than the threshold.
+#
+# usage: bench/run.sh [-n runs] [-c baseline] [-t percent] forth.exe
+
+runs=3
+baseline=
+threshold=10
+
+while getopts n:c:t: opt; do
+	case $opt in
+		n) runs=$OPTARG ;;
+		c) baseline=$OPTARG ;;
+		t) threshold=$OPTARG ;;
+		*) echo "usage: $0 [-n runs] [-c baseline] [-t percent] forth.exe" >&2; exit 2 ;;
+	esac
+done
+shift $((OPTIND - 1))
+
+if [ -n "$baseline" ] && [ ! -r "$baseline" ]; then
+	echo "$0: baseline $baseline not found, run make bench-baseline first" >&2
+	exit 2
+fi
+
+forth=${1:-./forth.exe}
+dir=$(dirname "$0")
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+# generated programs: parsing of many string literals and words
+awk 'BEGIN {
+	for (i = 0; i < 1000; i++) {
+		printf "\" the quick brown fox %d jumps over\\tthe lazy dog\\n\" LENGTH DROP\n", i
+		printf "BL WORD token%d DROP CHAR x DROP ( comment %d ) \\ line comment\n", i, i
+	}
+	print "BYE"
+}' > "$tmp/strings.f"
+
+# compilation of thousands of definitions, each looked up by the next one
+awk 'BEGIN {
+	print ": W0 1 ;"
+	for (i = 1; i < 5000; i++)
+		printf ": W%d W%d DUP + DROP %d ;\n", i, i - 1, i
+	print "W20 DROP BYE"
+}' > "$tmp/dictionary.f"
+
+# SAVE/LOAD round trips of a system with a sizable dictionary and data area
+awk -v img="$tmp/bench.img" 'BEGIN {
+	for (i = 0; i < 1000; i++)
+		printf ": S%d %d DUP * ;\n", i, i
+	print "65536 ALLOT"
+	for (i = 0; i < 200; i++)
+		printf "\" %s\" SAVE \" %s\" LOAD\n", img, img
+	print "BYE"
+}' > "$tmp/saveload.f"
+
+now() {
+	date +%s%N
+}
+
+status=0
+for f in "$dir"/fib.f "$dir"/sieve.f "$dir"/bubble.f "$tmp"/strings.f "$tmp"/dictionary.f "$dir"/try.f "$tmp"/saveload.f; do
+	name=$(basename "$f" .f)
+	best=
+	i=0
+	while [ $i -lt "$runs" ]; do
+		start=$(now)
+		if ! "$forth" "$f" < /dev/null > "$tmp/out" 2>&1 || grep -q '^Error' "$tmp/out"; then
+			echo "$name: failed" >&2
+			cat "$tmp/out" >&2
+			exit 2
+		fi
+		t=$(( $(now) - start ))
+		if [ -z "$best" ] || [ $t -lt $best ]; then
+			best=$t
+		fi
+		i=$((i + 1))
+	done
+	seconds=$(awk -v ns="$best" 'BEGIN { printf "%.4f", ns / 1e9 }')
+
+	if [ -z "$baseline" ]; then
+		echo "$name $seconds"
+	else
+		awk -v name="$name" -v cur="$seconds" -v th="$threshold" '
+			$1 == name { base = $2 }
+			END {
+				if (base == "") {
+					printf "%-12s %10s %10.4f    new\n", name, "-", cur
+					exit 0
+				}
+				change = (cur - base) / base * 100
+				printf "%-12s %10.4f %10.4f %+8.1f%%%s\n", name, base, cur, change, (change > th ? "    REGRESSION" : "")
+				exit (change > th)
+			}' "$baseline" || status=1
+	fi
+done
+
+exit $status
@@ -0,0 +1,20 @@
+\ Sieve of Eratosthenes: C@/C! in nested DO LOOPs
+
+8192 CONSTANT SIZE
+CREATE FLAGS SIZE ALLOT
+
+: PRIMES ( -- n )
+	FLAGS SIZE 1 FILL
+	0 SIZE 2 DO
+		FLAGS I + C@ IF
+			1+
+			I DUP * SIZE < IF
+				SIZE I DUP * DO 0 FLAGS I + C! J +LOOP
+			THEN
+		THEN
+	LOOP ;
+
+: SIEVE 0 200 0 DO DROP PRIMES LOOP ;
+
+SIEVE . CR
+BYE
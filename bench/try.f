@@ -0,0 +1,8 @@
+\ Error paths: fth_error() message formatting, longjmp and TRY state restoring
+
+: BAD 1 0 / ;
+: CATCHER TRY BAD DROP ;
+: TRIES 1000000 0 DO CATCHER LOOP ;
+
+TRIES
+BYE
@@ -1,2005 +1,5645 @@
-#include <string.h>
-#include <ctype.h>
-#include <stdarg.h>
-#include <errno.h>
-#include <stdlib.h>
-
-#ifndef FORTH_NO_SAVES
-#  include <stdio.h>
-#endif
-
-#include "forth.h"
-
-
-// ================================ Macros ====================================
-
-// aliases
-#define push(x)		fth_push(x)
-#define pop()		fth_pop()
-#define fetch(a)	fth_fetch(a)
-#define store(a, x)	fth_store((a), (x))
-#define cfetch(a)	fth_cfetch(a)
-#define cstore(a, c)	fth_cstore((a), (c))
-#define reset()		fth_reset()
-#define F		forth
-
-// error handling
-#define error(...)	fth_error(__VA_ARGS__)
-#define check(cond, ...) \
-			if (cond) error(__VA_ARGS__)
-#define invaliddataaddr(a) \
-			((a) <= 0 || (a) >= F.datacap)
-#define checkdata(a, s)	check(invaliddataaddr(a) || invaliddataaddr((a) + (s)), "invalid data area %d (%d bytes)", (a), (s))
-#define checkcode(a)	check((a) <= 0 || (a) >= F.codecap, "invalid code address %d", (a))
-
-// parsing
-#define SOURCELEFT	(F.intp < strlen(F.source))
-#define CURCHAR		(F.source[F.intp])
-#define ISSEP(sep, c)	(((sep) == (c)) || ((sep) == ' ' && strchr(" \t\n\r", (c))))
-
-// dictionary
-
-// flags
-#define FLAG(x)		(1 << (x))
-#define IMMEDIATE	FLAG(0)
-#define SMUDGED		FLAG(1)
-#define SET(x, flag)	((x) |= (flag))
-#define CLR(x, flag)	((x) &= ~(flag))
-#define ISSET(x, flag)	(((x) & (flag)) != 0)
-
-// save file marks
-#define SYSTEM_MARK	'S'
-#define PROGRAM_MARK	'P'
-#define DATA_MARK	'D'
-
-
-// ================================= Types ====================================
-
-
-
-// ================================== Data ====================================
-
-enum core_codes {
-	// control flow
-	LIT = CORE_PRIM_FIRST,
-	ENTER,
-	EXIT,
-	BRANCH,
-	QBRANCH,
-	DODO,
-	DOQDO,
-	DOLOOP,
-	DOADDLOOP,
-	DO,
-	QDO,
-	LOOP,
-	ADDLOOP,
-	IF,
-	ELSE,
-	THEN,
-	BEGIN,
-	UNTIL,
-	AGAIN,
-	WHILE,
-	REPEAT,
-	LEAVE,
-	I,
-	J,
-	COLON,
-	SEMICOLON,
-	EXECUTE,
-	DOTRY,
-	TRY,
-	ERROR,
-	
-	// arithmetic
-	ADD,
-	SUB,
-	MUL,
-	DIV,
-	MOD,
-	DIVMOD,
-	NEGATE,
-	ONEADD,
-	ONESUB,
-	CELL,
-	CELLS,
-	CELLADD,
-	CELLSUB,
-	MIN,
-	MAX,
-	ABS,
-	
-	// stack
-	SWAP,
-	DUP,
-	DROP,
-	ROT,
-	MROT,
-	TUCK,
-	OVER,
-	NIP,
-	DDUP,
-	DDROP,
-	QDUP,
-	
-	// logic
-	AND,
-	OR,
-	NOT,
-	XOR,
-	LESS,
-	LESSEQUAL,
-	GREATER,
-	GREATEREQUAL,
-	EQUAL,
-	NOTEQUAL,
-	ZEROLESS,
-	ZEROGREATER,
-	ZEROEQUAL,
-	ZERONOTEQUAL,
-	FALSE,
-	TRUE,
-	WITHIN,
-	BETWEEN,
-	
-	// data
-	DOCONSTANT,
-	DOVARIABLE,
-	CONSTANT,
-	VARIABLE,
-	DODOES,
-	FETCH,
-	STORE,
-	CFETCH,
-	CSTORE,
-	COMMA,
-	CCOMMA,
-	CREATE,
-	DOES,
-	ADDSTORE,
-	DOVALUE,
-	VALUE,
-	TO,
-	HERE,
-	ALLOT,
-	TODATA,
-	MOVE,
-	FILL,
-	ERASE,
-	
-	// compilation
-	CODECOMMA,
-	COMPILE,
-	COMPILENOW,
-	TICK,
-	TICKNOW,
-	MAKEIMMEDIATE,
-	STATE,
-	COMPON,
-	COMPOFF,
-	BLOCKSTART,
-	BLOCKEND,
-	LENCODE,
-	LENDICT,
-	LENNAMES,
-	
-	// parsing, strings and tools
-	BLOCKCOMMENT,
-	LINECOMMENT,
-	CHAR,
-	QUOTE,
-	DEPTH,
-	LENGTH,
-	COUNT,
-	BL,
-	STRING,
-	WORD,
-	VOCABULARY,
-	DOVOCABULARY,
-	DEFINITIONS,
-	SAVE,
-	LOAD,
-	SAVEPROGRAM,
-	SAVEDATA,
-	LOADDATA,
-	
-	NUM_CORE_PRIM
-};
-
-
-primitive_word_t core_words[] = {
-	// control flow
-	{"EXIT",		EXIT,			0},
-	{"DO",			DO,			1},
-	{"?DO",			QDO,			1},
-	{"LOOP",		LOOP,			1},
-	{"+LOOP",		ADDLOOP,		1},
-	{"IF",			IF,			1},
-	{"ELSE",		ELSE,			1},
-	{"THEN",		THEN,			1},
-	{"BEGIN",		BEGIN,			1},
-	{"UNTIL",		UNTIL,			1},
-	{"AGAIN",		AGAIN,			1},
-	{"WHILE",		WHILE,			1},
-	{"REPEAT",		REPEAT,			1},
-	{"LEAVE",		LEAVE,			0},
-	{"I",			I,			0},
-	{"J",			J,			0},
-	{":",			COLON,			0},
-	{";",			SEMICOLON,		1},
-	{"EXECUTE",		EXECUTE,		0},
-	{"TRY",			TRY,			1},
-	{"ERROR",		ERROR,			0},
-	
-	// arithmetic
-	{"+",			ADD,			0},
-	{"-",			SUB,			0},
-	{"*",			MUL,			0},
-	{"/",			DIV,			0},
-	{"MOD",			MOD,			0},
-	{"/MOD",		DIVMOD,			0},
-	{"NEGATE",		NEGATE,			0},
-	{"1+",			ONEADD,			0},
-	{"1-",			ONESUB,			0},
-	{"CELL",		CELL,			0},
-	{"CELLS",		CELLS,			0},
-	{"CELL+",		CELLADD,		0},
-	{"CELL-",		CELLSUB,		0},
-	{"MIN",			MIN,			0},
-	{"MAX",			MAX,			0},
-	{"ABS",			ABS,			0},
-	
-	// stack
-	{"SWAP",		SWAP,			0},
-	{"DUP",			DUP,			0},
-	{"DROP",		DROP,			0},
-	{"ROT",			ROT,			0},
-	{"-ROT",		MROT,			0},
-	{"TUCK",		TUCK,			0},
-	{"OVER",		OVER,			0},
-	{"NIP",			NIP,			0},
-	{"2DUP",		DDUP,			0},
-	{"2DROP",		DDROP,			0},
-	{"?DUP",		QDUP,			0},
-	
-	// logic
-	{"AND",			AND,			0},
-	{"OR",			OR,			0},
-	{"NOT",			NOT,			0},
-	{"XOR",			XOR,			0},
-	{"<",			LESS,			0},
-	{"<=",			LESSEQUAL,		0},
-	{">",			GREATER,		0},
-	{">=",			GREATEREQUAL,		0},
-	{"=",			EQUAL,			0},
-	{"<>",			NOTEQUAL,		0},
-	{"0<",			ZEROLESS,		0},
-	{"0>",			ZEROGREATER,		0},
-	{"0=",			ZEROEQUAL,		0},
-	{"0<>",			ZERONOTEQUAL,		0},
-	{"FALSE",		FALSE,			0},
-	{"TRUE",		TRUE,			0},
-	{"WITHIN",		WITHIN,			0},
-	{"BETWEEN",		BETWEEN,		0},
-	
-	// data
-	{"CONSTANT",		CONSTANT,		0},
-	{"VARIABLE",		VARIABLE,		0},
-	{"@",			FETCH,			0},
-	{"!",			STORE,			0},
-	{"C@",			CFETCH,			0},
-	{"C!",			CSTORE,			0},
-	{",",			COMMA,			0},
-	{"C,",			CCOMMA,			0},
-	{"CREATE",		CREATE,			0},
-	{"DOES>",		DOES,			0},
-	{"+!",			ADDSTORE,		0},
-	{"VALUE",		VALUE,			0},
-	{"TO",			TO,			1},
-	{"HERE",		HERE,			0},
-	{"ALLOT",		ALLOT,			0},
-	{">DATA",		TODATA,			0},
-	{"MOVE",		MOVE,			0},
-	{"FILL",		FILL,			0},
-	{"ERASE",		ERASE,			0},
-	
-	// compilation
-	{"CODE,",		CODECOMMA,		0},
-	{"COMPILE",		COMPILE,		1},
-	{"[COMPILE]",		COMPILENOW,		1},
-	{"'",			TICK,			0},
-	{"[']",			TICKNOW,		1},
-	{"IMMEDIATE",		MAKEIMMEDIATE,		0},
-	{"STATE",		STATE,			0},
-	{"]",			COMPON,			0},
-	{"[",			COMPOFF,		1},
-	{"{",			BLOCKSTART,		0},
-	{"}",			BLOCKEND,		1},
-	{"#CODE",		LENCODE,		0},
-	{"#DICT",		LENDICT,		0},
-	{"#NAMES",		LENNAMES,		0},
-	
-	// parsing, strings and tools
-	{"(",			BLOCKCOMMENT,		1},
-	{"\\",			LINECOMMENT,		1},
-	{"CHAR",		CHAR,			1},
-	{"\"",			QUOTE,			1},
-	{"DEPTH",		DEPTH,			0},
-	{"LENGTH",		LENGTH,			0},
-	{"COUNT",		COUNT,			0},
-	{"BL",			BL,			0},
-	{"STRING",		STRING,			0},
-	{"WORD",		WORD,			0},
-	{"VOCABULARY",		VOCABULARY,		0},
-	{"DEFINITIONS",		DEFINITIONS,		0},
-#  ifndef FORTH_NO_SAVES
-	{"SAVE",		SAVE,			0},
-	{"LOAD",		LOAD,			0},
-	{"SAVE-PROGRAM",	SAVEPROGRAM,		0},
-	{"SAVE-DATA",		SAVEDATA,		0},
-	{"LOAD-DATA",		LOADDATA,		0},
-#  endif
-	
-	{NULL,			0,			0}
-};
-
-
-// ============================== Forth state =================================
-
-forth_t F;
-
-// ============================== Prototypes ==================================
-
-static void core_prims(int prim, int pfa);
-
-
-// =============================== Functions ==================================
-
-static int endian(void)
-{
-	int x = 1;
-	return *(char *)&x == 1 ? -1 : 1;
-}
-
-static void rpush(void)
-{
-	check(F.rsp >= RSTACK_SIZE, "return stack overflow");
-	F.rstack[F.rsp].ip = F.ip;
-	F.rstack[F.rsp].xt = F.running;
-	F.rsp++;
-}
-
-
-static void rpop(void)
-{
-	check(F.rsp <= 0, "return stack underflow");
-	--F.rsp;
-	F.ip = F.rstack[F.rsp].ip;
-	F.running = F.rstack[F.rsp].xt;
-}
-
-
-static void lpush(int index, int limit, int leave)
-{
-	check(F.lsp >= LSTACK_SIZE, "loop stack overflow");
-	F.lstack[F.lsp].index = index;
-	F.lstack[F.lsp].limit = limit;
-	F.lstack[F.lsp].leave = leave;
-	F.lstack[F.lsp].xt = F.running;
-	F.lsp++;
-}
-
-
-static void lpop(void)
-{
-	check(F.lsp <= 0, "loop stack underflow");
-	F.lsp--;
-}
-
-
-static void cfpush(enum cftype type, int ref)
-{
-	check(F.cfsp >= CFSTACK_SIZE, "too nested control structures");
-	F.cfstack[F.cfsp].type = type;
-	F.cfstack[F.cfsp].ref = ref;
-	F.cfsp++;
-}
-
-
-static int cfpop(enum cftype required)
-{
-	check(F.cfsp <= 0, "unbalanced control structure");
-	F.cfsp--;
-	check(F.cfstack[F.cfsp].type != required, "unbalanced control structure");
-	return F.cfstack[F.cfsp].ref;
-}
-
-
-static enum cftype cfpeek(void)
-{
-	check(F.cfsp <= 0, "unbalanced control structure");
-	return F.cfstack[F.cfsp - 1].type;
-}
-
-
-static int reserve(void **area, int *size, int p, int required)
-{
-	void *newarea;
-	int newsize = *size;
-	
-	while (p + required > newsize) {
-		newsize *= 2;
-		newarea = realloc(*area, newsize);
-		if (!newarea)
-			return 0;
-		*area = newarea;
-		*size = newsize;
-		(*(char **)area)[newsize - 1] = 0;
-	}
-	return 1;
-}
-
-
-static void compile(int x)
-{
-	check(!reserve((void **)&F.code, &F.codecap, F.cp * sizeof(int), sizeof(int)), "unable to expand code area");
-	F.code[F.cp++] = x;
-}
-
-
-static void dcompile(int x)
-{
-	check(!reserve((void **)&F.data, &F.datacap, F.dp, sizeof(int)), "unable to expand data area");
-#ifdef FORTH_ALIGNMENT_HACK
-	memcpy(&F.data[F.dp], &x, sizeof(int));
-#else
-	*(int *)&F.data[F.dp] = x;
-#endif
-	F.dp += sizeof(int);
-}
-
-
-static void ccompile(int c)
-{
-	check(!reserve((void **)&F.data, &F.datacap, F.dp, 1), "unable to expand data area");
-	F.data[F.dp++] = c;
-}
-
-
-static void scompile(const char *s, int size)
-{
-	int escape = 0;
-	
-	while (size) {
-		switch (*s) {
-			case '\\':
-				if (escape) {
-					ccompile(*s);
-					escape = 0;
-				} else {
-					escape = 1;
-				}
-				break;
-			case 'n':
-				if (escape) {
-					ccompile('\n');
-					escape = 0;
-				} else {
-					ccompile(*s);
-				}
-				break;
-			case 't':
-				if (escape) {
-					ccompile('\t');
-					escape = 0;
-				} else {
-					ccompile(*s);
-				}
-				break;
-			case 'r':
-				if (escape) {
-					ccompile('\r');
-					escape = 0;
-				} else {
-					ccompile(*s);
-				}
-				break;
-			case 'b':
-				if (escape) {
-					ccompile('\b');
-					escape = 0;
-				} else {
-					ccompile(*s);
-				}
-				break;
-			default:
-				ccompile(*s);
-				escape = 0;
-				break;
-		}
-		s++, size--;
-	}
-	ccompile('\0');
-}
-
-
-static void execute(int xt)
-{
-	int prim = F.code[xt];
-	int orsp = F.rsp;
-	
-	core_prims(prim, xt + 1);
-	
-	while (orsp < F.rsp) {
-		xt = F.code[F.ip++];
-		prim = F.code[xt];
-		core_prims(prim, xt + 1);
-	}
-}
-
-
-static void create(const char *name, int flags, int prim)
-{
-	int name_size = strlen(name) + 1;
-	
-	check(!reserve((void **)&F.dict, &F.dictcap, F.dictp * sizeof(int), sizeof(word_t)), "unable to expand dictionary area while creating %s", name);
-	check(!reserve((void **)&F.names, &F.namescap, F.namesp, name_size), "unable to expand names area while creating %s", name);
-	F.dict[F.dictp].link = F.code[F.current];
-	F.code[F.current] = F.dictp;
-	F.dict[F.dictp].flags = flags;
-	F.dict[F.dictp].xt = F.cp;
-	compile(prim);
-	F.dict[F.dictp].name = F.namesp;
-	strcpy(&F.names[F.namesp], name);
-	F.namesp += name_size;
-	F.dictp++;
-}
-
-
-static int getword(char sep)
-{
-	char *wordp = F.word;
-	
-	while (SOURCELEFT && ISSEP(sep, CURCHAR))
-		F.intp++;
-	
-	if (!SOURCELEFT)
-		return 0;
-	
-	while (SOURCELEFT && !ISSEP(sep, CURCHAR)) {
-		if (wordp < F.word + WORD_MAX - 1)
-			*wordp++ = CURCHAR;
-		F.intp++;
-	}
-	
-	*wordp = '\0';
-	
-	if (SOURCELEFT)
-		F.intp++;
-	
-	return 1;
-}
-
-
-static int parse(char sep, int *pstart, int *plength)
-{
-	int start = F.intp, length = 0;
-	int escape = 0;
-	
-	if (!SOURCELEFT)
-		return 0;
-	
-	while (SOURCELEFT) {
-		if (CURCHAR == '\\') {
-			F.intp++, length++;
-			escape = !escape;
-		} else if (ISSEP(sep, CURCHAR)) {
-			if (escape) {
-				F.intp++, length++;
-				escape = 0;
-			} else {
-				break;
-			}
-		} else {
-			F.intp++, length++;
-			escape = 0;
-		}
-	}
-	
-	if (!SOURCELEFT)
-		return 0;
-	
-	F.intp++;
-		
-	if (pstart)
-		*pstart = start;
-	if (plength)
-		*plength = length;
-	
-	return 1;
-}
-
-
-static word_t *find(const char *word)
-{
-	int p;		// dict address of next word to check
-	int voc = F.context;	// pfa of vocabulary
-	
-	do {
-		for (p = F.code[voc]; p; p = F.dict[p].link)
-			if (!ISSET(F.dict[p].flags, SMUDGED) && strcasecmp(&F.names[F.dict[p].name], word) == 0)
-				return &F.dict[p];
-		voc = F.code[voc + 1];
-	} while (voc);
-	
-	/* Uncomment to enable CURRENT-vocabulary search
-	if (F.context == F.current)
-		return NULL;
-	
-	voc = F.current;
-	do {
-		for (p = F.code[voc]; p; p = F.dict[p].link)
-			if (!ISSET(F.dict[p].flags, SMUDGED) && strcasecmp(&F.names[F.dict[p].name], word) == 0)
-				return &F.dict[p];
-		voc = F.code[voc + 1];
-	} while (voc);
-	//*/
-	
-	return NULL;
-}
-
-
-static int toliteral(int *n)
-{
-	int ret, read;
-	
-	if (sscanf(F.word, "%d%n", &ret, &read) == 1 && read == strlen(F.word)) {
-		if (n)
-			*n = ret;
-		return 1;
-	}
-	
-	if (sscanf(F.word, "0%*[Xx]%x%n", &ret, &read) == 1 && read == strlen(F.word)) {
-		if (n)
-			*n = ret;
-		return 1;
-	}
-	
-	return 0;
-}
-
-
-static void do_interpret(void)
-{
-	int n;
-	word_t *w;
-	
-	while (SOURCELEFT) {
-		if (!getword(' '))
-			break;
-		w = find(F.word);
-		if (w) {
-			if (F.state == 0 || ISSET(w->flags, IMMEDIATE))
-				execute(w->xt);
-			else
-				compile(w->xt);
-		} else if (F.app_notfound && F.app_notfound(F.word)) {
-			// app_notfound() has already done the job
-		} else if (toliteral(&n)) {
-			if (F.state) {
-				compile(F.lit_xt);
-				compile(n);
-			} else {
-				push(n);
-			}
-		} else {
-			error("%s ?", F.word);
-		}
-	}
-}
-
-
-#ifndef FORTH_NO_SAVES
-static void saveprogram(const char *fname, int entry)
-{
-	char sig[4] = {PROGRAM_MARK, endian(), sizeof(int), 0};
-	FILE *f;
-	
-	f = fopen(fname, "wb");
-	check(!f, "save error: %s", strerror(errno));
-	
-	check(fwrite(sig, 1, 4, f) < 4, "save error: %s", strerror(errno));
-	check(fwrite(&entry, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
-	check(fwrite(&F.cp, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
-	check(fwrite(F.code, sizeof(int), F.cp, f) < F.cp, "save error: %s", strerror(errno));
-	check(fwrite(&F.dp, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
-	check(fwrite(F.data, 1, F.dp, f) < F.dp, "save error: %s", strerror(errno));
-	
-	check(fwrite(&F.lit_xt, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
-	check(fwrite(&F.exit_xt, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
-	check(fwrite(&F.branch_xt, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
-	check(fwrite(&F.qbranch_xt, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
-	check(fwrite(&F.dodo_xt, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
-	check(fwrite(&F.doqdo_xt, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
-	check(fwrite(&F.doloop_xt, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
-	check(fwrite(&F.doaddloop_xt, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
-	check(fwrite(&F.codecomma_xt, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
-	check(fwrite(&F.store_xt, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
-	check(fwrite(&F.dotry_xt, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
-	
-	fclose(f);
-}
-#endif
-
-
-static void markfwd(enum cftype type)
-{
-	cfpush(type, F.cp);
-	compile(0);
-}
-
-
-static void resolvefwd(enum cftype required)
-{
-	F.code[cfpop(required)] = F.cp;
-}
-
-
-static void markback(enum cftype type)
-{
-	cfpush(type, F.cp);
-}
-
-
-static void resolveback(enum cftype required)
-{
-	compile(cfpop(required));
-}
-
-
-static void core_prims(int prim, int pfa)
-{
-	switch (prim) {
-		// control flow
-		case LIT:
-			push(F.code[F.ip++]);
-			break;
-		case ENTER:
-			rpush();
-			F.running = pfa - 1;
-			F.ip = pfa;
-			break;
-		case EXIT:
-			while (F.lsp > 0 && F.lstack[F.lsp - 1].xt == F.running)
-				lpop();
-			rpop();
-			break;
-		case BRANCH:
-			F.ip = F.code[F.ip];
-			break;
-		case QBRANCH:
-			if (pop())
-				F.ip++;
-			else
-				F.ip = F.code[F.ip];
-			break;
-		case DODO: {
-			int index = pop(), limit = pop(), leave = F.code[F.ip++];
-			lpush(index, limit, leave);
-			break;
-		}
-		case DOQDO: {
-			int index = pop(), limit = pop(), leave = F.code[F.ip++];
-			if (index != limit)
-				lpush(index, limit, leave);
-			else
-				F.ip = leave;
-			break;
-		}
-		case DOLOOP:
-			check(F.lsp <= 0, "usage of LOOP outside any loop");
-			if (++F.lstack[F.lsp - 1].index == F.lstack[F.lsp - 1].limit) {
-				F.ip++;
-				lpop();
-			} else {
-				F.ip = F.code[F.ip];
-			}
-			break;
-		case DOADDLOOP: {
-			int step = pop(), index, limit;
-			check(F.lsp <= 0, "usage of +LOOP outside any loop");
-			index = F.lstack[F.lsp - 1].index;
-			limit = F.lstack[F.lsp - 1].limit;
-			if ((index < limit) == (index + step < limit)) {
-				F.lstack[F.lsp - 1].index += step;
-				F.ip = F.code[F.ip];
-			} else {
-				F.ip++;
-				lpop();
-			}
-			break;
-		}
-		case DO:
-			compile(F.dodo_xt);
-			markfwd(CFDO);
-			markback(CFLOOP);
-			break;
-		case QDO:
-			compile(F.doqdo_xt);
-			markfwd(CFDO);
-			markback(CFLOOP);
-			break;
-		case LOOP:
-			compile(F.doloop_xt);
-			resolveback(CFLOOP);
-			resolvefwd(CFDO);
-			break;
-		case ADDLOOP:
-			compile(F.doaddloop_xt);
-			resolveback(CFLOOP);
-			resolvefwd(CFDO);
-			break;
-		case IF:
-			compile(F.qbranch_xt);
-			markfwd(CFIF);
-			break;
-		case ELSE: {
-			int ifbranch;
-			check(cfpeek() != CFIF, "unbalanced control structure");
-			ifbranch = cfpop(CFIF);
-			compile(F.branch_xt);
-			markfwd(CFELSE);
-			cfpush(CFIF, ifbranch);
-			resolvefwd(CFIF);
-			break;
-		}
-		case THEN: {
-			enum cftype type = cfpeek();
-			check(type != CFIF && type != CFELSE, "unbalanced control structure");
-			resolvefwd(type);
-			break;
-		}
-		case BEGIN:
-			markback(CFBEGIN);
-			break;
-		case UNTIL:
-			compile(F.qbranch_xt);
-			resolveback(CFBEGIN);
-			break;
-		case AGAIN:
-			compile(F.branch_xt);
-			resolveback(CFBEGIN);
-			break;
-		case WHILE: {
-			int beginbranch = cfpop(CFBEGIN);
-			compile(F.qbranch_xt);
-			markfwd(CFWHILE);
-			cfpush(CFBEGIN, beginbranch);
-			break;
-		}
-		case REPEAT:
-			compile(F.branch_xt);
-			resolveback(CFBEGIN);
-			resolvefwd(CFWHILE);
-			break;
-		case LEAVE:
-			check(F.lsp <= 0, "attempt to use LEAVE outside any loop");
-			check(F.lstack[F.lsp - 1].xt != F.running, "LEAVE called from nested definition");
-			F.ip = F.lstack[F.lsp - 1].leave;
-			lpop();
-			break;
-		case I:
-			check(F.lsp <= 0, "attempt to use I outside any loop");
-			push(F.lstack[F.lsp - 1].index);
-			break;
-		case J:
-			check(F.lsp <= 1, "attempt to use J without outer loop");
-			push(F.lstack[F.lsp - 2].index);
-			break;
-		case COLON:
-			check(getword(' ') == 0, "word required for :");
-			create(F.word, SMUDGED, ENTER);
-			F.state = FORTH_BOOL(1);
-			break;
-		case SEMICOLON:
-			check(F.state == 0, "; is used outside any definition");
-			check(F.cfsp > 0, "unbalanced control structure");
-			compile(F.exit_xt);
-			CLR(F.dict[F.code[F.current]].flags, SMUDGED);
-			F.state = 0;
-			break;
-		case EXECUTE: {
-			int xt = pop();
-			checkcode(xt);
-			execute(xt);
-			break;
-		}
-		case DOTRY: {
-			jmp_buf ojmp;
-			int osp = F.sp, orsp = F.rsp, olsp = F.lsp, oip = F.ip, orunning = F.running;
-			const char *osource = F.source;
-			int ointp = F.intp, ostate = F.state;
-			memcpy(ojmp, F.errjmp, sizeof(jmp_buf));
-			F.errhandlers++;
-			if (setjmp(F.errjmp) == 0) {
-				int xt = F.code[F.ip++];
-				checkcode(xt);
-				execute(xt);
-				memcpy(F.errjmp, ojmp, sizeof(jmp_buf));
-				F.errhandlers--;
-				push(~0);
-			} else {
-				F.sp = osp, F.rsp = orsp, F.lsp = olsp, F.ip = oip, F.running = orunning;
-				if (F.running)
-					F.ip++;
-				F.source = osource;
-				F.intp = ointp, F.state = ostate;
-				memcpy(F.errjmp, ojmp, sizeof(jmp_buf));
-				F.errhandlers--;
-				push(0);
-			}
-			break;
-		}
-		case TRY: {
-			word_t *w;
-			check(getword(' ') == 0, "word required for TRY");
-			w = find(F.word);
-			check(!w, "%s ?", F.word);
-			
-			if (F.state) {
-				compile(F.dotry_xt);
-				compile(w->xt);
-			} else {
-				jmp_buf ojmp;
-				int osp = F.sp, orsp = F.rsp, olsp = F.lsp, oip = F.ip, orunning = F.running;
-				const char *osource = F.source;
-				int ointp = F.intp, ostate = F.state;
-				memcpy(ojmp, F.errjmp, sizeof(jmp_buf));
-				F.errhandlers++;
-				if (setjmp(F.errjmp) == 0) {
-					checkcode(w->xt);
-					execute(w->xt);
-					memcpy(F.errjmp, ojmp, sizeof(jmp_buf));
-					F.errhandlers--;
-					push(~0);
-				} else {
-					F.sp = osp, F.rsp = orsp, F.lsp = olsp, F.ip = oip, F.running = orunning;
-					if (F.running)
-						F.ip++;
-					F.source = osource;
-					F.intp = ointp, F.state = ostate;
-					memcpy(F.errjmp, ojmp, sizeof(jmp_buf));
-					F.errhandlers--;
-					push(0);
-				}
-			}
-			break;
-		}
-		case ERROR:
-			fth_error("%s", fth_area(fth_pop(), 1));
-			break;
-			
-		// arithmetic
-		case ADD: {
-			int b = pop(), a = pop();
-			push(a + b);
-			break;
-		}
-		case SUB: {
-			int b = pop(), a = pop();
-			push(a - b);
-			break;
-		}
-		case MUL: {
-			int b = pop(), a = pop();
-			push(a * b);
-			break;
-		}
-		case DIV: {
-			int b = pop(), a = pop();
-			check(b == 0, "division by zero");
-			push(a / b);
-			break;
-		}
-		case MOD: {
-			int b = pop(), a = pop();
-			check(b == 0, "division by zero");
-			push(a % b);
-			break;
-		}
-		case DIVMOD: {
-			int b = pop(), a = pop();
-			check(b == 0, "division by zero");
-			push(a % b);
-			push(a / b);
-			break;
-		}
-		case NEGATE:
-			push(-pop());
-			break;
-		case ONEADD:
-			push(pop() + 1);
-			break;
-		case ONESUB:
-			push(pop() - 1);
-			break;
-		case CELL:
-			push(sizeof(int));
-			break;
-		case CELLS:
-			push(pop() * sizeof(int));
-			break;
-		case CELLADD:
-			push(pop() + sizeof(int));
-			break;
-		case CELLSUB:
-			push(pop() - sizeof(int));
-			break;
-		case MIN: {
-			int b = pop(), a = pop();
-			push(a < b ? a : b);
-			break;
-		}
-		case MAX: {
-			int b = pop(), a = pop();
-			push(a > b ? a : b);
-			break;
-		}
-		case ABS: {
-			int a = pop();
-			push(a < 0 ? -a : a);
-			break;
-		}
-		
-		// stack
-		case SWAP: {
-			int b = pop(), a = pop();
-			push(b);
-			push(a);
-			break;
-		}
-		case DUP: {
-			int a = pop();
-			push(a);
-			push(a);
-			break;
-		}
-		case DROP:
-			(void)pop();
-			break;
-		case ROT: {
-			int c = pop(), b = pop(), a = pop();
-			push(b);
-			push(c);
-			push(a);
-			break;
-		}
-		case MROT: {
-			int c = pop(), b = pop(), a = pop();
-			push(c);
-			push(a);
-			push(b);
-			break;
-		}
-		case TUCK: {
-			int b = pop(), a = pop();
-			push(b);
-			push(a);
-			push(b);
-			break;
-		}
-		case OVER: {
-			int b = pop(), a = pop();
-			push(a);
-			push(b);
-			push(a);
-			break;
-		}
-		case NIP: {
-			int b = pop();
-			(void)pop();
-			push(b);
-			break;
-		}
-		case DDUP: {
-			int b = pop(), a = pop();
-			push(a);
-			push(b);
-			push(a);
-			push(b);
-			break;
-		}
-		case DDROP:
-			(void)pop();
-			(void)pop();
-			break;
-		case QDUP: {
-			int a = pop();
-			if (a)
-				push(a);
-			push(a);
-			break;
-		}
-		
-		// logic
-		case AND: {
-			int b = pop(), a = pop();
-			push(a & b);
-			break;
-		}
-		case OR: {
-			int b = pop(), a = pop();
-			push(a | b);
-			break;
-		}
-		case NOT:
-			push(~pop());
-			break;
-		case XOR: {
-			int b = pop(), a = pop();
-			push(a ^ b);
-			} break;
-		case LESS: {
-			int b = pop(), a = pop();
-			push(FORTH_BOOL(a < b));
-			break;
-		}
-		case LESSEQUAL: {
-			int b = pop(), a = pop();
-			push(FORTH_BOOL(a <= b));
-			break;
-		}
-		case GREATER: {
-			int b = pop(), a = pop();
-			push(FORTH_BOOL(a > b));
-			break;
-		}
-		case GREATEREQUAL: {
-			int b = pop(), a = pop();
-			push(FORTH_BOOL(a >= b));
-			break;
-		}
-		case EQUAL: {
-			int b = pop(), a = pop();
-			push(FORTH_BOOL(a == b));
-			break;
-		}
-		case NOTEQUAL: {
-			int b = pop(), a = pop();
-			push(FORTH_BOOL(a != b));
-			break;
-		}
-		case ZEROLESS:
-			push(FORTH_BOOL(pop() < 0));
-			break;
-		case ZEROGREATER:
-			push(FORTH_BOOL(pop() > 0));
-			break;
-		case ZEROEQUAL:
-			push(FORTH_BOOL(pop() == 0));
-			break;
-		case ZERONOTEQUAL:
-			push(FORTH_BOOL(pop()));
-			break;
-		case FALSE:
-			push(0);
-			break;
-		case TRUE:
-			push(~0);
-			break;
-		case WITHIN: {
-			int b = pop(), a = pop(), x = pop();
-			push(FORTH_BOOL(a <= x && x < b));
-			break;
-		}
-		case BETWEEN: {
-			int b = pop(), a = pop(), x = pop();
-			push(FORTH_BOOL(a <= x && x <= b));
-			break;
-		}
-		
-		// data
-		case DOCONSTANT:
-			push(F.code[pfa]);
-			break;
-		case DOVARIABLE:
-			push(F.code[pfa]);		// is variable a constant !?!!
-			break;
-		case CONSTANT:
-			check(getword(' ') == 0, "word required for CONSTANT");
-			create(F.word, 0, DOCONSTANT);
-			compile(pop());
-			break;
-		case VARIABLE:
-			check(getword(' ') == 0, "word required for VARIABLE");
-			create(F.word, 0, DOVARIABLE);
-			compile(F.dp);
-			compile(0);			// xt of DOES>-part
-			dcompile(0);
-			break;
-		case DODOES:
-			push(F.code[pfa]);
-			rpush();
-			F.running = pfa - 1;
-			F.ip = F.code[pfa + 1];
-			break;
-		case FETCH:
-			push(fetch(pop()));
-			break;
-		case STORE: {
-			int a = pop(), x = pop();
-			store(a, x);
-			break;
-		}
-		case CFETCH:
-			push(cfetch(pop()) & 0xFF);
-			break;
-		case CSTORE: {
-			int a = pop(), x = pop();
-			cstore(a, x);
-			break;
-		}
-		case COMMA:
-			dcompile(pop());
-			break;
-		case CCOMMA:
-			ccompile(pop());
-			break;
-		case CREATE:
-			check(getword(' ') == 0, "word required for CREATE");
-			create(F.word, 0, DOVARIABLE);
-			compile(F.dp);
-			compile(0);			// xt of DOES>-part
-			break;
-		case DOES:
-			check(F.code[F.dict[F.code[F.current]].xt] != DOVARIABLE, "%s is not CREATEd", &F.names[F.dict[F.code[F.current]].name]);
-			F.code[F.dict[F.code[F.current]].xt] = DODOES;
-			if (F.running) {
-				F.code[F.dict[F.code[F.current]].xt + 2] = F.ip;
-				rpop();
-			} else {
-				F.code[F.dict[F.code[F.current]].xt + 2] = F.cp;
-				F.state = FORTH_BOOL(1);
-			}
-			break;
-		case ADDSTORE: {
-			int a = pop();
-			store(a, fetch(a) + pop());
-			break;
-		}
-		case DOVALUE:
-			push(fetch(F.code[pfa]));
-			break;
-		case VALUE:
-			check(getword(' ') == 0, "word required for VALUE");
-			create(F.word, 0, DOVALUE);
-			compile(F.dp);
-			dcompile(0);
-			break;
-		case TO: {
-			word_t *w;
-			check(getword(' ') == 0, "word required for TO");
-			w = find(F.word);
-			check(w == NULL, "%s ?", F.word);
-			check(F.code[w->xt] != DOVALUE, "%s is not a VALUE", F.word);
-			if (F.state) {
-				compile(F.lit_xt);
-				compile(F.code[w->xt + 1]);
-				compile(F.store_xt);
-			} else {
-				store(F.code[w->xt + 1], pop());
-			}
-			break;
-		}
-		case HERE:
-			push(F.dp);
-			break;
-		case ALLOT: {
-			int size = pop();
-			check(!reserve((void **)&F.data, &F.datacap, F.dp, size), "unable to expand data area while ALLOTing %d bytes", size);
-			F.dp += size;
-			break;
-		}
-		case TODATA: {
-			int xt = pop();
-			checkcode(xt);
-			check(F.code[xt] != DOVARIABLE && F.code[xt] != DODOES, "attempt to get data address of something, that is not CREATEd");
-			push(F.code[xt + 1]);
-			break;
-		}
-		case MOVE: {
-			int size = pop(), b = pop(), a = pop();
-			checkdata(a, size);
-			checkdata(b, size);
-			memmove(&F.data[b], &F.data[a], size);
-			break;
-		}
-		case FILL: {
-			int c = pop(), size = pop(), a = pop();
-			checkdata(a, size);
-			memset(&F.data[a], c, size);
-			break;
-		}
-		case ERASE: {
-			int size = pop(), a = pop();
-			checkdata(a, size);
-			memset(&F.data[a], 0, size);
-			break;
-		}
-		
-		// compilation
-		case CODECOMMA:
-			compile(pop());
-			break;
-		case COMPILE: {
-			word_t *w;
-			check(getword(' ') == 0, "word required for COMPILE");
-			w = find(F.word);
-			check(w == NULL, "%s ?", F.word);
-			compile(F.lit_xt);
-			compile(w->xt);
-			compile(F.codecomma_xt);
-			break;
-		}
-		case COMPILENOW: {
-			word_t *w;
-			check(getword(' ') == 0, "word required for [COMPILE]");
-			w = find(F.word);
-			check(w == NULL, "%s ?", F.word);
-			compile(w->xt);
-			break;
-		}
-		case TICK: {
-			word_t *w;
-			check(getword(' ') == 0, "word required for '");
-			w = find(F.word);
-			check(w == NULL, "%s ?", F.word);
-			push(w->xt);
-			break;
-		}
-		case TICKNOW: {
-			word_t *w;
-			check(getword(' ') == 0, "word required for [']");
-			w = find(F.word);
-			check(w == NULL, "%s ?", F.word);
-			compile(F.lit_xt);
-			compile(w->xt);
-			break;
-		}
-		case MAKEIMMEDIATE:
-			SET(F.dict[F.code[F.current]].flags, IMMEDIATE);
-			break;
-		case STATE:
-			push(FORTH_BOOL(F.state));
-			break;
-		case COMPON:
-			F.state = ~0;
-			break;
-		case COMPOFF:
-			F.state = 0;
-			break;
-		case BLOCKSTART:
-			F.state = ~0;
-			push(F.cp);
-			compile(ENTER);
-			break;
-		case BLOCKEND:
-			check(F.state == 0, "attempt to use } outside any definition");
-			check(F.cfsp > 0, "unbalanced control structure");
-			F.state = 0;
-			compile(F.exit_xt);
-			execute(pop());
-			break;
-		case LENCODE:
-			push(F.cp);
-			break;
-		case LENDICT:
-			push(F.dictp);
-			break;
-		case LENNAMES:
-			push(F.namesp);
-			break;
-		
-		// parsing, strings and tools
-		case BLOCKCOMMENT:
-			check(parse(')', NULL, NULL) == 0, "unmatched (");
-			break;
-		case LINECOMMENT:
-			parse('\n', NULL, NULL);
-			break;
-		case CHAR:
-			check(getword(' ') == 0, "word required for CHAR");
-			if (F.state) {
-				compile(F.lit_xt);
-				compile(F.word[0]);
-			} else {
-				push(F.word[0]);
-			}
-			break;
-		case QUOTE: {
-			int start, length;
-			check(parse('"', &start, &length) == 0, "unmatched \"");
-			if (F.state) {
-				compile(F.lit_xt);
-				compile(F.dp);
-			} else {
-				push(F.dp);
-			}
-			scompile(&F.source[start], length);
-			break;
-		}
-		case DEPTH:
-			push(F.sp);
-			break;
-		case LENGTH: {
-			int a = pop();
-			checkdata(a, 1);
-			push(strlen(&F.data[a]));
-			break;
-		}
-		case COUNT: {
-			int a = pop();
-			checkdata(a, 1);
-			push(a);
-			push(strlen(&F.data[a]));
-			break;
-		}
-		case BL:
-			push(' ');
-			break;
-		case STRING: {
-			int sep = pop(), start, length;
-			check(!parse(sep, &start, &length), "string separated by `%c' required for STRING", sep);
-			push(F.dp);
-			scompile(&F.source[start], length);
-			break;
-		}
-		case WORD:
-			check(getword(pop()) == 0, "word required for WORD");
-			check(!reserve((void **)&F.dp, &F.datacap, F.dp, strlen(F.word) + 1), "unable to expand data area while placing word %s", F.word);
-			strcpy(&F.data[F.dp], F.word);
-			push(F.dp);
-			break;
-		case VOCABULARY:
-			check(getword(' ') == 0, "word required for VOCABULARY");
-			create(F.word, 0, DOVOCABULARY);
-			compile(0);			// dict address of latest definition in this voc
-			compile(F.current);		// link to parent voc
-			break;
-		case DOVOCABULARY:
-			F.context = pfa;
-			break;
-		case DEFINITIONS:
-			F.current = F.context;
-			break;
-#ifndef FORTH_NO_SAVES
-		case SAVE: {
-			int a = pop();
-			checkdata(a, 1);
-			fth_savesystem(&F.data[a]);
-			break;
-		}
-		case LOAD: {
-			int a = pop();
-			checkdata(a, 1);
-			fth_loadsystem(&F.data[a]);
-			break;
-		}
-		case SAVEPROGRAM: {
-			int entry = pop();
-			int a = pop();
-			checkcode(entry);
-			checkdata(a, 1);
-			saveprogram(&F.data[a], entry);
-			break;
-		}
-		case SAVEDATA: {
-			int a = pop();
-			checkdata(a, 1);
-			fth_savedata(&F.data[a]);
-			break;
-		}
-		case LOADDATA: {
-			int a = pop();
-			checkdata(a, 1);
-			fth_loaddata(&F.data[a]);
-			break;
-		}
-#endif
-		
-		default:
-			F.app_prims(prim);
-			break;
-	}
-}
-
-
-// ================================== API =====================================
-
-// ... for application primitives
-void fth_error(const char *fmt, ...)
-{
-	va_list args;
-	
-	if (fmt != F.errormsg) {		// for re-throwing error messages
-		va_start(args, fmt);
-		vsnprintf(F.errormsg, ERROR_MAX, fmt, args);
-		va_end(args);
-	}
-	
-	if (F.errhandlers)
-		longjmp(F.errjmp, 1);
-	else
-		abort();
-}
-
-
-void fth_push(int x)
-{
-	check(F.sp >= STACK_SIZE, "stack overflow");
-	F.stack[F.sp++] = x;
-}
-
-
-int fth_pop(void)
-{
-	check(F.sp <= 0, "stack underflow");
-	return F.stack[--F.sp];
-}
-
-
-int fth_fetch(int a)
-{
-#ifdef FORTH_ALIGNMENT_HACK
-	int x;
-	checkdata(a, sizeof(int));
-	memcpy(&x, &F.data[a], sizeof(int));
-	return x;
-#else
-	checkdata(a, sizeof(int));
-	return *(int *)&F.data[a];
-#endif
-}
-
-
-void fth_store(int a, int x)
-{
-	checkdata(a, sizeof(int));
-#ifdef FORTH_ALIGNMENT_HACK
-	memcpy(&F.data[a], &x, sizeof(int));
-#else
-	*(int *)&F.data[a] = x;
-#endif
-}
-
-
-char fth_cfetch(int a)
-{
-	checkdata(a, 1);
-	return F.data[a];
-}
-
-
-void fth_cstore(int a, char x)
-{
-	checkdata(a, 1);
-	F.data[a] = x;
-}
-
-
-char *fth_area(int a, int size)
-{
-	checkdata(a, size);
-	return &F.data[a];
-}
-
-
-void fth_init(primitives_f app_primitives, notfound_f app_notfnd)
-{
-	F.app_prims = app_primitives;
-	F.app_notfound = app_notfnd;
-	F.code = (int *)malloc(CODE_INITIAL_SIZE * sizeof(int));
-	check(!F.code, "");
-	F.codecap = CODE_INITIAL_SIZE * sizeof(int);
-	F.data = (char *)malloc(DATA_INITIAL_SIZE);
-	check(!F.data, "");
-	F.datacap = DATA_INITIAL_SIZE;
-	F.dict = (word_t *)malloc(DICT_INITIAL_SIZE * sizeof(word_t));
-	check(!F.dict, "");
-	F.dictcap = DICT_INITIAL_SIZE * sizeof(word_t);
-	F.names = (char *)malloc(NAMES_INITIAL_SIZE);
-	check(!F.names, "");
-	F.namescap = NAMES_INITIAL_SIZE;
-	F.data[DATA_INITIAL_SIZE - 1] = '\0';
-	reset();
-	F.cp = F.dp = 1;		// 0 is an "invalid" address
-	F.errhandlers = 0;
-	
-	// initial vocabulary
-	F.namesp = 0;
-	F.dictp = 1;
-	F.context = F.current = 0;
-	F.code[0] = 0;
-	create("FORTH", 0, DOVOCABULARY);
-	F.context = F.current = F.forth_voc = F.cp;
-	compile(1);
-	compile(0);
-	
-	// core xt-s
-	F.lit_xt = F.cp;		compile(LIT);
-	F.branch_xt = F.cp;		compile(BRANCH);
-	F.qbranch_xt = F.cp;		compile(QBRANCH);
-	F.dodo_xt = F.cp;		compile(DODO);
-	F.doqdo_xt = F.cp;		compile(DOQDO);
-	F.doloop_xt = F.cp;		compile(DOLOOP);
-	F.doaddloop_xt = F.cp;		compile(DOADDLOOP);
-	F.dotry_xt = F.cp;		compile(DOTRY);
-	
-	fth_library(core_words);
-	
-	F.exit_xt = find("EXIT")->xt;
-	F.codecomma_xt = find("CODE,")->xt;
-	F.store_xt = find("!")->xt;
-}
-
-
-void fth_free(void)
-{
-	free(F.code);
-	free(F.data);
-	free(F.dict);
-	free(F.names);
-}
-
-
-void fth_primitive(const char *name, int code, int immediate)
-{
-	create(name, immediate ? IMMEDIATE : 0, code);
-}
-
-
-int fth_interpret(const char *s)
-{
-	const char *osource = F.source;
-	int ointp = F.intp;
-	jmp_buf oerr;
-	int ret;
-	
-	memcpy(oerr, F.errjmp, sizeof(jmp_buf));
-	F.errhandlers++;
-	if (setjmp(F.errjmp) == 0) {
-		F.source = s;
-		F.intp = 0;
-		do_interpret();
-		ret = 1;
-		F.intp = ointp;
-		F.source = osource;
-	} else {
-		ret = 0;
-	}
-	memcpy(F.errjmp, oerr, sizeof(jmp_buf));
-	F.errhandlers--;
-	return ret;
-}
-
-
-int fth_execute(const char *w)
-{
-	word_t *pw;
-	jmp_buf oerr;
-	int ret;
-	
-	memcpy(oerr, F.errjmp, sizeof(jmp_buf));
-	F.errhandlers++;
-	if (setjmp(F.errjmp) == 0) {
-		pw = find(w);
-		check(pw == NULL, "%s ?", w);
-		execute(pw->xt);
-		ret = 1;
-	} else {
-		ret = 0;
-	}
-	
-	memcpy(F.errjmp, oerr, sizeof(jmp_buf));
-	F.errhandlers--;
-	return ret;
-}
-
-
-void fth_library(primitive_word_t *lib)
-{
-	int i;
-	
-	for (i = 0; lib[i].name; i++)
-		fth_primitive(lib[i].name, lib[i].code, lib[i].immediate);
-}
-
-
-int fth_getstate(void)
-{
-	return F.state;
-}
-
-
-void fth_reset(void)
-{
-	F.sp = F.rsp = F.lsp = F.cfsp = 0;
-	F.running = 0;
-	F.errormsg[0] = 0;
-	F.errhandlers = 0;
-	F.state = 0;
-	F.context = F.current = F.forth_voc;
-}
-
-
-const char *fth_geterror(void)
-{
-	return F.errormsg;
-}
-
-
-int fth_getdepth(void)
-{
-	return F.sp;
-}
-
-
-int fth_getstack(int idx)
-{
-	if (idx >= 0 && idx < F.sp)
-		return F.stack[idx];
-	else
-		return 0;
-}
-
-
-const char *fth_geterrorline(int *plen, int *pintp, int *plineno)
-{
-	int line = 1, beg = 0, end, i;
-	
-	if (!F.source)
-		return NULL;
-	
-	if (F.intp > 0)
-		F.intp--;
-	
-	while (F.intp > 0 && (F.intp == strlen(F.source) || ISSEP(' ', CURCHAR)))
-		F.intp--;
-	
-	for (i = 0; i < F.intp; i++)
-		if (F.source[i] == '\n') {
-			line++;
-			beg = i + 1;
-		}
-	
-	for (; i < strlen(F.source); i++)
-		if (F.source[i] == '\n')
-			break;
-	end = i;
-	
-	if (plen)
-		*plen = end - beg;
-	if (pintp)
-		*pintp = F.intp - beg;
-	if (plineno)
-		*plineno = line;
-	return &F.source[beg];
-}
-
-
-int fth_gettracedepth(void)
-{
-	return F.rsp;
-}
-
-
-const char *fth_gettrace(int idx)
-{
-	int xt, pw, voc;
-	
-	if (idx < 0 || idx >= F.rsp)
-		return "<invalid backtrace index>";
-	
-	if (idx == F.rsp - 1)
-		xt = F.running;
-	else
-		xt = F.rstack[idx + 1].xt;
-	
-	voc = F.context;
-	do {
-		for (pw = F.code[voc]; pw; pw = F.dict[pw].link)
-			if (F.dict[pw].xt == xt)
-				return &F.names[F.dict[pw].name];
-		voc = F.code[voc + 1];
-	} while (voc);
-	
-	return "<unknown>";
-}
-
-
-#ifndef FORTH_NO_SAVES
-void fth_savesystem(const char *fname)
-{
-	char sig[4] = {SYSTEM_MARK, endian(), sizeof(int), 0};
-	FILE *f = fopen(fname, "wb");
-	
-	check(!f, "save error: %s", strerror(errno));
-
-	check(fwrite(sig, 1, 4, f) < 4, "save error: %s", strerror(errno));
-	check(fwrite(&F.cp, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
-	check(fwrite(F.code, sizeof(int), F.cp, f) < F.cp, "save error: %s", strerror(errno));
-	check(fwrite(&F.dp, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
-	check(fwrite(F.data, 1, F.dp, f) < F.dp, "save error: %s", strerror(errno));
-	check(fwrite(&F.dictp, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
-	check(fwrite(F.dict, sizeof(word_t), F.dictp, f) < F.dictp, "save error: %s", strerror(errno));
-	check(fwrite(&F.namesp, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
-	check(fwrite(F.names, 1, F.namesp, f) < F.namesp, "save error: %s", strerror(errno));
-	check(fwrite(&F.forth_voc, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
-	
-	check(fwrite(&F.lit_xt, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
-	check(fwrite(&F.exit_xt, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
-	check(fwrite(&F.branch_xt, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
-	check(fwrite(&F.qbranch_xt, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
-	check(fwrite(&F.dodo_xt, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
-	check(fwrite(&F.doqdo_xt, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
-	check(fwrite(&F.doloop_xt, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
-	check(fwrite(&F.doaddloop_xt, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
-	check(fwrite(&F.codecomma_xt, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
-	check(fwrite(&F.store_xt, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
-	check(fwrite(&F.dotry_xt, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
-	
-	fclose(f);
-}
-
-
-void fth_loadsystem(const char *fname)
-{
-	char sig[4];
-	FILE *f = fopen(fname, "rb");
-	
-	check(!f, "load error: %s", strerror(errno));
-	
-	check(fread(sig, 1, 4, f) < 4, "load error: %s", strerror(errno));
-	check(sig[0] != SYSTEM_MARK, "load error: invalid system mark: %c", sig[0]);
-	check(sig[1] != endian(), "system is saved for different data endianness: %d (we have %d)", sig[1], endian());
-	check(sig[2] != sizeof(int), "system is saved for different cell size: %d (we have %d)", sig[2], sizeof(int));
-	check(sig[3] != 0, "signature reserved byte is non-zero");
-	
-	check(fread(&F.cp, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
-	check(!reserve((void **)&F.code, &F.codecap, F.cp * sizeof(int), 0), "unable to expand code area for loading system state");
-	check(fread(F.code, sizeof(int), F.cp, f) < F.cp, "load error: %s", strerror(errno));
-	check(fread(&F.dp, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
-	check(!reserve((void **)&F.data, &F.datacap, F.dp, 0), "unable to expand data area for loading system state");
-	check(fread(F.data, 1, F.dp, f) < F.dp, "load error: %s", strerror(errno));
-	check(fread(&F.dictp, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
-	check(!reserve((void **)&F.dict, &F.dictcap, F.dictp * sizeof(word_t), 0), "unable to expand dictionary area for loading system state");
-	check(fread(F.dict, sizeof(word_t), F.dictp, f) < F.dictp, "load error: %s", strerror(errno));
-	check(fread(&F.namesp, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
-	check(!reserve((void **)&F.names, &F.namescap, F.namesp, 0), "unable to expand names area for loading system state");
-	check(fread(F.names, 1, F.namesp, f) < F.namesp, "load error: %s", strerror(errno));
-	check(fread(&F.forth_voc, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
-	
-	check(fread(&F.lit_xt, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
-	check(fread(&F.exit_xt, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
-	check(fread(&F.branch_xt, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
-	check(fread(&F.qbranch_xt, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
-	check(fread(&F.dodo_xt, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
-	check(fread(&F.doqdo_xt, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
-	check(fread(&F.doloop_xt, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
-	check(fread(&F.doaddloop_xt, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
-	check(fread(&F.codecomma_xt, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
-	check(fread(&F.store_xt, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
-	check(fread(&F.dotry_xt, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
-	
-	fclose(f);
-	fth_reset();
-}
-
-
-void fth_saveprogram(const char *fname, const char *entry)
-{
-	word_t *w = find(entry);
-	
-	check(w == NULL, "%s ?", entry);
-	saveprogram(fname, w->xt);
-}
-
-
-int fth_runprogram(const char *fname)
-{
-	char sig[4];
-	int entry;
-	FILE *f = fopen(fname, "rb");
-	jmp_buf oerr;
-	int ret;
-	
-	check(!f, "load error: %s", strerror(errno));
-	
-	check(fread(sig, 1, 4, f) < 4, "load error: %s", strerror(errno));
-	check(sig[0] != PROGRAM_MARK, "load error: invalid program mark: %c", sig[0]);
-	check(sig[1] != endian(), "program is saved for different data endianness: %d (we have %d)", sig[1], endian());
-	check(sig[2] != sizeof(int), "program is saved for different cell size: %d (we have %d)", sig[2], sizeof(int));
-	check(sig[3] != 0, "signature reserved byte is non-zero");
-	
-	check(fread(&entry, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
-	check(fread(&F.cp, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
-	check(!reserve((void **)&F.code, &F.codecap, F.cp * sizeof(int), 0), "unable to expand code area for loading system state");
-	check(fread(F.code, sizeof(int), F.cp, f) < F.cp, "load error: %s", strerror(errno));
-	check(fread(&F.dp, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
-	check(!reserve((void **)&F.data, &F.datacap, F.dp, 0), "unable to expand data area for loading system state");
-	check(fread(F.data, 1, F.dp, f) < F.dp, "load error: %s", strerror(errno));
-	
-	check(fread(&F.lit_xt, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
-	check(fread(&F.exit_xt, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
-	check(fread(&F.branch_xt, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
-	check(fread(&F.qbranch_xt, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
-	check(fread(&F.dodo_xt, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
-	check(fread(&F.doqdo_xt, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
-	check(fread(&F.doloop_xt, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
-	check(fread(&F.doaddloop_xt, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
-	check(fread(&F.codecomma_xt, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
-	check(fread(&F.store_xt, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
-	check(fread(&F.dotry_xt, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
-	
-	fclose(f);
-	fth_reset();
-	
-	memcpy(oerr, F.errjmp, sizeof(jmp_buf));
-	F.errhandlers++;
-	if (setjmp(F.errjmp) == 0) {
-		checkcode(entry);
-		execute(entry);
-		ret = 1;
-	} else {
-		ret = 0;
-	}
-	memcpy(F.errjmp, oerr, sizeof(jmp_buf));
-	F.errhandlers--;
-	return ret;
-}
-
-
-void fth_savedata(const char *fname)
-{
-	char sig[4] = {DATA_MARK, endian(), sizeof(int), 0};
-	FILE *f;
-	
-	f = fopen(fname, "wb");
-	check(!f, "save error: %s", strerror(errno));
-	
-	check(fwrite(sig, 1, 4, f) < 4, "save error: %s", strerror(errno));
-	check(fwrite(&F.dp, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
-	check(fwrite(F.data, 1, F.dp, f) < F.dp, "save error: %s", strerror(errno));
-	
-	fclose(f);
-}
-
-
-void fth_loaddata(const char *fname)
-{
-	char sig[4];
-	FILE *f = fopen(fname, "rb");
-	
-	check(!f, "load error: %s", strerror(errno));
-	
-	check(fread(sig, 1, 4, f) < 4, "load error: %s", strerror(errno));
-	check(sig[0] != DATA_MARK, "load error: invalid data mark: %c", sig[0]);
-	check(sig[1] != endian(), "program is saved for different data endianness: %d (we have %d)", sig[1], endian());
-	check(sig[2] != sizeof(int), "program is saved for different cell size: %d (we have %d)", sig[2], sizeof(int));
-	check(sig[3] != 0, "signature reserved byte is non-zero");
-	
-	check(fread(&F.dp, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
-	check(!reserve((void **)&F.data, &F.datacap, F.dp, 0), "unable to expand data area for loading data");
-	check(fread(F.data, 1, F.dp, f) < F.dp, "load error: %s", strerror(errno));
-	
-	fclose(f);
-}
-
-#endif
-
-
-
-
-
-
+#ifdef FORTH_REACTOR
+#  define _GNU_SOURCE			// accept4(), pipe2()
+#endif
+
+#include <string.h>
+#include <ctype.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <limits.h>
+
+#if !defined(FORTH_NO_SAVES) || defined(FORTH_OPSTATS) || defined(FORTH_SAMPLER) || !defined(FORTH_NO_TRACER) || !defined(FORTH_NO_OUTPUT)
+#  include <stdio.h>
+#endif
+
+#ifdef FORTH_SAMPLER
+#  include <signal.h>
+#  include <sys/time.h>
+#endif
+
+#ifdef FORTH_REACTOR
+#  include <sys/epoll.h>
+#  include <sys/socket.h>
+#  include <sys/un.h>
+#  include <unistd.h>
+#  include <fcntl.h>
+#  include <sys/stat.h>
+#endif
+
+#ifdef FORTH_THREADS
+#  include <pthread.h>
+#  include <unistd.h>
+#endif
+
+#ifdef _WIN32
+#  include <windows.h>
+#else
+#  include <time.h>
+#endif
+
+#include "forth.h"
+
+#if !defined(FORTH_NO_CHANNELS) && defined(FORTH_NO_ATOMICS)
+#  error Channels need atomics, define FORTH_NO_CHANNELS too
+#endif
+
+#ifdef FORTH_STATIC_CORE
+#  include "core_image.h"
+#endif
+
+
+// ================================ Macros ====================================
+
+// aliases
+#define push(x)		fth_push(x)
+#define pop()		fth_pop()
+#define fetch(a)	fth_fetch(a)
+#define store(a, x)	fth_store((a), (x))
+#define cfetch(a)	fth_cfetch(a)
+#define cstore(a, c)	fth_cstore((a), (c))
+#define reset()		fth_reset()
+#define F		forth
+
+// error handling
+#define error(...)	fth_error(__VA_ARGS__)
+#define check(cond, ...) \
+			if (cond) error(__VA_ARGS__)
+#define invaliddataaddr(a) \
+			((a) <= 0 || (a) >= F.datacap)
+#define checkdata(a, s)	check(invaliddataaddr(a) || invaliddataaddr((a) + (s)), "invalid data area %d (%d bytes)", (a), (s))
+#define checkcode(a)	check((a) <= 0 || (a) >= F.codecap, "invalid code address %d", (a))
+
+// data access
+#define MAPINDEX(a)	((unsigned)((a) - MAP_FIRST) / MAP_SPAN)
+#define MAPOFFSET(a)	((unsigned)((a) - MAP_FIRST) % MAP_SPAN)
+#ifndef FORTH_NO_CHECKPOINTS
+#  define dataarea(a, s, w) \
+			(invaliddataaddr(a) || invaliddataaddr((a) + (s)) ? mapped((a), (s), (w)) : (w) && F.dirtymap ? dirty((a), (s)) : &F.data[a])
+#else
+#  define dataarea(a, s, w) \
+			(invaliddataaddr(a) || invaliddataaddr((a) + (s)) ? mapped((a), (s), (w)) : &F.data[a])
+#endif
+
+// parallel loop workers share the areas of the caller and can't add to them
+#ifdef FORTH_THREADS
+#  define checkworker()	check(F.worker, "definitions and data can't be added in parallel loop")
+#else
+#  define checkworker()
+#endif
+
+// statistics
+#define PEAK(peak, x)	if ((x) > (peak)) (peak) = (x)
+
+// execution budget: a step is counted at every call and branch, so any loop or recursion spends it
+// waiting words take no steps and check the deadline themselves
+#ifndef FORTH_NO_BUDGET
+#  define STEP()	if (--F.fuel < 0) refuel(pfa)
+#  define CHECKDEADLINE()	check(F.deadline && fth_nanotime() > F.deadline, "deadline exceeded")
+#else
+#  define STEP()
+#  define CHECKDEADLINE()
+#endif
+
+// parsing
+#define SOURCELEFT	(F.intp < strlen(F.source))
+#define CURCHAR		(F.source[F.intp])
+#define ISSEP(sep, c)	(((sep) == (c)) || ((sep) == ' ' && strchr(" \t\n\r", (c))))
+
+// dictionary
+
+// flags
+#define FLAG(x)		(1 << (x))
+#define IMMEDIATE	FLAG(0)
+#define SMUDGED		FLAG(1)
+#define SET(x, flag)	((x) |= (flag))
+#define CLR(x, flag)	((x) &= ~(flag))
+#define ISSET(x, flag)	(((x) & (flag)) != 0)
+
+// save file marks
+#define SYSTEM_MARK	'S'
+#define PROGRAM_MARK	'P'
+#define DATA_MARK	'D'
+// version of system and program files in the last signature byte, changed with opcodes or saved fields
+#define FORMAT_VERSION	1
+
+
+// ================================= Types ====================================
+
+enum trace_type {
+	TE_ENTER,
+	TE_EXIT,
+	TE_PRIM,
+	TE_PRIMEND,
+	TE_ERROR,
+	TE_CATCH,
+	TE_GROW,
+	TE_IO,
+	TE_IOEND
+};
+
+#ifndef FORTH_NO_CHANNELS
+// Bounded ring buffer of two-cell messages; head and tail are on separate cache lines
+typedef struct channel {
+	unsigned head;				// next message to receive
+	char headpad[60];
+	unsigned tail;				// next message to send
+	int sending;				// SPSC sender is between checking closed and publishing the tail
+	char tailpad[56];
+	unsigned mask;				// capacity - 1, capacity is a power of 2
+	int spsc;				// single producer and single consumer
+	int closed;
+	unsigned checkpoint;			// ckserial of the checkpoint it was created after, 0 - none
+	struct {
+		unsigned seq;			// message number expected in the cell, for MPMC channels
+		int x, y;
+		int skip;			// cell claimed by a sender that found the channel closed
+	} cells[];
+} channel_t;
+#endif
+
+enum trace_io {
+	IO_SAVESYSTEM,
+	IO_LOADSYSTEM,
+	IO_SAVEPROGRAM,
+	IO_SHAKEPROGRAM,
+	IO_RUNPROGRAM,
+	IO_SAVEDATA,
+	IO_LOADDATA
+};
+
+
+// ================================== Data ====================================
+
+enum core_codes {
+	// control flow
+	LIT = CORE_PRIM_FIRST,
+	LITXT,
+	ENTER,
+	EXIT,
+	BRANCH,
+	QBRANCH,
+	DODO,
+	DOQDO,
+	DOLOOP,
+	DOADDLOOP,
+	DO,
+	QDO,
+	LOOP,
+	ADDLOOP,
+	IF,
+	ELSE,
+	THEN,
+	BEGIN,
+	UNTIL,
+	AGAIN,
+	WHILE,
+	REPEAT,
+	LEAVE,
+	I,
+	J,
+	COLON,
+	SEMICOLON,
+	EXECUTE,
+	DOTRY,
+	TRY,
+	ERROR,
+	
+	// arithmetic
+	ADD,
+	SUB,
+	MUL,
+	DIV,
+	MOD,
+	DIVMOD,
+	NEGATE,
+	ONEADD,
+	ONESUB,
+	CELL,
+	CELLS,
+	CELLADD,
+	CELLSUB,
+	MIN,
+	MAX,
+	ABS,
+	
+	// stack
+	SWAP,
+	DUP,
+	DROP,
+	ROT,
+	MROT,
+	TUCK,
+	OVER,
+	NIP,
+	DDUP,
+	DDROP,
+	QDUP,
+	
+	// logic
+	AND,
+	OR,
+	NOT,
+	XOR,
+	LESS,
+	LESSEQUAL,
+	GREATER,
+	GREATEREQUAL,
+	EQUAL,
+	NOTEQUAL,
+	ZEROLESS,
+	ZEROGREATER,
+	ZEROEQUAL,
+	ZERONOTEQUAL,
+	FALSE,
+	TRUE,
+	WITHIN,
+	BETWEEN,
+	
+	// data
+	DOCONSTANT,
+	DOVARIABLE,
+	CONSTANT,
+	VARIABLE,
+	DODOES,
+	FETCH,
+	STORE,
+	CFETCH,
+	CSTORE,
+	COMMA,
+	CCOMMA,
+	CREATE,
+	DOES,
+	ADDSTORE,
+	DOVALUE,
+	VALUE,
+	TO,
+	HERE,
+	ALLOT,
+	TODATA,
+	MOVE,
+	FILL,
+	ERASE,
+	
+	// compilation
+	CODECOMMA,
+	COMPILE,
+	COMPILENOW,
+	TICK,
+	TICKNOW,
+	MAKEIMMEDIATE,
+	STATE,
+	COMPON,
+	COMPOFF,
+	BLOCKSTART,
+	BLOCKEND,
+	LENCODE,
+	LENDICT,
+	LENNAMES,
+	
+	// parsing, strings and tools
+	BLOCKCOMMENT,
+	LINECOMMENT,
+	CHAR,
+	QUOTE,
+	DEPTH,
+	LENGTH,
+	COUNT,
+	BL,
+	STRING,
+	WORD,
+	VOCABULARY,
+	DOVOCABULARY,
+	DEFINITIONS,
+	SAVE,
+	LOAD,
+	SAVEPROGRAM,
+	SHAKEPROGRAM,
+	SAVEDATA,
+	LOADDATA,
+	PROFILEON,
+	PROFILEOFF,
+	PROFILERESET,
+	DUMPOPSTATS,
+	RESETOPSTATS,
+	SAMPLEON,
+	SAMPLEOFF,
+	SAVESAMPLES,
+	TRACEON,
+	TRACEOFF,
+	SAVETRACE,
+	TYPE,
+	FLUSH,
+	LESSNUMBER,
+	NUMBER,
+	NUMBERS,
+	HOLD,
+	SIGN,
+	NUMBERGREATER,
+	TASK,
+	ACTIVATE,
+	PAUSE,
+	STOP,
+	PARDO,
+	PARLOOP,
+	PARFOR,
+	PARSUM,
+	PARMIN,
+	PARMAX,
+	SETWORKERS,
+	ATOMICFETCH,
+	ATOMICSTORE,
+	ATOMICADDSTORE,
+	CAS,
+	FENCE,
+	ALIGN,
+	ALIGNED,
+	CHANNEL,
+	SPSCCHANNEL,
+	SEND,
+	RECV,
+	TRYSEND,
+	TRYRECV,
+	SENDN,
+	RECVN,
+	SENDBUF,
+	RECVBUF,
+	CLOSECHANNEL,
+	OPENSOCKET,
+	LISTENSOCKET,
+	ACCEPT,
+	SOCKETPAIR,
+	PIPE,
+	READ,
+	WRITE,
+	CLOSE,
+	ONREADABLE,
+	ONWRITABLE,
+	AFTER,
+	EVERY,
+	CANCEL,
+	POLLEVENTS,
+	RUNEVENTS,
+	STOPEVENTS,
+	SETBUDGET,
+	FUEL,
+	YIELD,
+	DOPARLOOP,
+	
+	NUM_CORE_PRIM
+};
+
+// opcode counters: application opcodes below OPSTATS_APP_MAX, core opcodes and one for all the rest
+#define NUM_OPSTATS	(OPSTATS_APP_MAX + NUM_CORE_PRIM - CORE_PRIM_FIRST + 1)
+
+
+primitive_word_t core_words[] = {
+	// control flow
+	{"EXIT",		EXIT,			0},
+	{"DO",			DO,			1},
+	{"?DO",			QDO,			1},
+	{"LOOP",		LOOP,			1},
+	{"+LOOP",		ADDLOOP,		1},
+	{"IF",			IF,			1},
+	{"ELSE",		ELSE,			1},
+	{"THEN",		THEN,			1},
+	{"BEGIN",		BEGIN,			1},
+	{"UNTIL",		UNTIL,			1},
+	{"AGAIN",		AGAIN,			1},
+	{"WHILE",		WHILE,			1},
+	{"REPEAT",		REPEAT,			1},
+	{"LEAVE",		LEAVE,			0},
+	{"I",			I,			0},
+	{"J",			J,			0},
+	{":",			COLON,			0},
+	{";",			SEMICOLON,		1},
+	{"EXECUTE",		EXECUTE,		0},
+	{"TRY",			TRY,			1},
+	{"ERROR",		ERROR,			0},
+	
+	// arithmetic
+	{"+",			ADD,			0},
+	{"-",			SUB,			0},
+	{"*",			MUL,			0},
+	{"/",			DIV,			0},
+	{"MOD",			MOD,			0},
+	{"/MOD",		DIVMOD,			0},
+	{"NEGATE",		NEGATE,			0},
+	{"1+",			ONEADD,			0},
+	{"1-",			ONESUB,			0},
+	{"CELL",		CELL,			0},
+	{"CELLS",		CELLS,			0},
+	{"CELL+",		CELLADD,		0},
+	{"CELL-",		CELLSUB,		0},
+	{"MIN",			MIN,			0},
+	{"MAX",			MAX,			0},
+	{"ABS",			ABS,			0},
+	
+	// stack
+	{"SWAP",		SWAP,			0},
+	{"DUP",			DUP,			0},
+	{"DROP",		DROP,			0},
+	{"ROT",			ROT,			0},
+	{"-ROT",		MROT,			0},
+	{"TUCK",		TUCK,			0},
+	{"OVER",		OVER,			0},
+	{"NIP",			NIP,			0},
+	{"2DUP",		DDUP,			0},
+	{"2DROP",		DDROP,			0},
+	{"?DUP",		QDUP,			0},
+	
+	// logic
+	{"AND",			AND,			0},
+	{"OR",			OR,			0},
+	{"NOT",			NOT,			0},
+	{"XOR",			XOR,			0},
+	{"<",			LESS,			0},
+	{"<=",			LESSEQUAL,		0},
+	{">",			GREATER,		0},
+	{">=",			GREATEREQUAL,		0},
+	{"=",			EQUAL,			0},
+	{"<>",			NOTEQUAL,		0},
+	{"0<",			ZEROLESS,		0},
+	{"0>",			ZEROGREATER,		0},
+	{"0=",			ZEROEQUAL,		0},
+	{"0<>",			ZERONOTEQUAL,		0},
+	{"FALSE",		FALSE,			0},
+	{"TRUE",		TRUE,			0},
+	{"WITHIN",		WITHIN,			0},
+	{"BETWEEN",		BETWEEN,		0},
+	
+	// data
+	{"CONSTANT",		CONSTANT,		0},
+	{"VARIABLE",		VARIABLE,		0},
+	{"@",			FETCH,			0},
+	{"!",			STORE,			0},
+	{"C@",			CFETCH,			0},
+	{"C!",			CSTORE,			0},
+	{",",			COMMA,			0},
+	{"C,",			CCOMMA,			0},
+	{"CREATE",		CREATE,			0},
+	{"DOES>",		DOES,			0},
+	{"+!",			ADDSTORE,		0},
+	{"VALUE",		VALUE,			0},
+	{"TO",			TO,			1},
+	{"HERE",		HERE,			0},
+	{"ALLOT",		ALLOT,			0},
+	{">DATA",		TODATA,			0},
+	{"MOVE",		MOVE,			0},
+	{"FILL",		FILL,			0},
+	{"ERASE",		ERASE,			0},
+	{"ALIGN",		ALIGN,			0},
+	{"ALIGNED",		ALIGNED,		0},
+#  ifndef FORTH_NO_ATOMICS
+	{"ATOMIC@",		ATOMICFETCH,		0},
+	{"ATOMIC!",		ATOMICSTORE,		0},
+	{"ATOMIC+!",		ATOMICADDSTORE,		0},
+	{"CAS",			CAS,			0},
+	{"FENCE",		FENCE,			0},
+#  endif
+	
+	// compilation
+	{"CODE,",		CODECOMMA,		0},
+	{"COMPILE",		COMPILE,		1},
+	{"[COMPILE]",		COMPILENOW,		1},
+	{"'",			TICK,			0},
+	{"[']",			TICKNOW,		1},
+	{"IMMEDIATE",		MAKEIMMEDIATE,		0},
+	{"STATE",		STATE,			0},
+	{"]",			COMPON,			0},
+	{"[",			COMPOFF,		1},
+	{"{",			BLOCKSTART,		0},
+	{"}",			BLOCKEND,		1},
+	{"#CODE",		LENCODE,		0},
+	{"#DICT",		LENDICT,		0},
+	{"#NAMES",		LENNAMES,		0},
+	
+	// parsing, strings and tools
+	{"(",			BLOCKCOMMENT,		1},
+	{"\\",			LINECOMMENT,		1},
+	{"CHAR",		CHAR,			1},
+	{"\"",			QUOTE,			1},
+	{"DEPTH",		DEPTH,			0},
+	{"LENGTH",		LENGTH,			0},
+	{"COUNT",		COUNT,			0},
+	{"BL",			BL,			0},
+	{"STRING",		STRING,			0},
+	{"WORD",		WORD,			0},
+	{"VOCABULARY",		VOCABULARY,		0},
+	{"DEFINITIONS",		DEFINITIONS,		0},
+#  ifndef FORTH_NO_SAVES
+	{"SAVE",		SAVE,			0},
+	{"LOAD",		LOAD,			0},
+	{"SAVE-PROGRAM",	SAVEPROGRAM,		0},
+	{"SHAKE-PROGRAM",	SHAKEPROGRAM,		0},
+	{"SAVE-DATA",		SAVEDATA,		0},
+	{"LOAD-DATA",		LOADDATA,		0},
+#  endif
+#  ifndef FORTH_NO_PROFILER
+	{"PROFILE-ON",		PROFILEON,		0},
+	{"PROFILE-OFF",		PROFILEOFF,		0},
+	{"PROFILE-RESET",	PROFILERESET,		0},
+#  endif
+#  ifdef FORTH_OPSTATS
+	{"DUMP-OPSTATS",	DUMPOPSTATS,		0},
+	{"RESET-OPSTATS",	RESETOPSTATS,		0},
+#  endif
+#  ifndef FORTH_NO_TRACER
+	{"TRACE-ON",		TRACEON,		0},
+	{"TRACE-OFF",		TRACEOFF,		0},
+	{"SAVE-TRACE",		SAVETRACE,		0},
+#  endif
+#  ifndef FORTH_NO_OUTPUT
+	{"TYPE",		TYPE,			0},
+	{"FLUSH",		FLUSH,			0},
+	{"<#",			LESSNUMBER,		0},
+	{"#",			NUMBER,			0},
+	{"#S",			NUMBERS,		0},
+	{"HOLD",		HOLD,			0},
+	{"SIGN",		SIGN,			0},
+	{"#>",			NUMBERGREATER,		0},
+#  endif
+#  ifndef FORTH_NO_TASKS
+	{"TASK",		TASK,			0},
+	{"ACTIVATE",		ACTIVATE,		0},
+	{"PAUSE",		PAUSE,			0},
+	{"STOP",		STOP,			0},
+#  endif
+#  ifndef FORTH_NO_CHANNELS
+	{"CHANNEL",		CHANNEL,		0},
+	{"SPSC-CHANNEL",	SPSCCHANNEL,		0},
+	{"SEND",		SEND,			0},
+	{"RECV",		RECV,			0},
+	{"TRY-SEND",		TRYSEND,		0},
+	{"TRY-RECV",		TRYRECV,		0},
+	{"SEND-N",		SENDN,			0},
+	{"RECV-N",		RECVN,			0},
+	{"SEND-BUF",		SENDBUF,		0},
+	{"RECV-BUF",		RECVBUF,		0},
+	{"CLOSE-CHANNEL",	CLOSECHANNEL,		0},
+#  endif
+#  ifdef FORTH_REACTOR
+	{"OPEN-SOCKET",		OPENSOCKET,		0},
+	{"LISTEN-SOCKET",	LISTENSOCKET,		0},
+	{"ACCEPT",		ACCEPT,			0},
+	{"SOCKETPAIR",		SOCKETPAIR,		0},
+	{"PIPE",		PIPE,			0},
+	{"READ",		READ,			0},
+	{"WRITE",		WRITE,			0},
+	{"CLOSE",		CLOSE,			0},
+	{"ON-READABLE",		ONREADABLE,		0},
+	{"ON-WRITABLE",		ONWRITABLE,		0},
+	{"AFTER",		AFTER,			0},
+	{"EVERY",		EVERY,			0},
+	{"CANCEL",		CANCEL,			0},
+	{"POLL-EVENTS",		POLLEVENTS,		0},
+	{"RUN-EVENTS",		RUNEVENTS,		0},
+	{"STOP-EVENTS",		STOPEVENTS,		0},
+#  endif
+#  ifndef FORTH_NO_BUDGET
+	{"SET-BUDGET",		SETBUDGET,		0},
+	{"FUEL",		FUEL,			0},
+#  endif
+#  ifndef FORTH_NO_RESUMABLE
+	{"YIELD",		YIELD,			0},
+#  endif
+#  ifdef FORTH_THREADS
+	{"PAR-DO",		PARDO,			1},
+	{"PAR-LOOP",		PARLOOP,		1},
+	{"PAR-FOR",		PARFOR,			0},
+	{"PAR-SUM",		PARSUM,			0},
+	{"PAR-MIN",		PARMIN,			0},
+	{"PAR-MAX",		PARMAX,			0},
+	{"SET-WORKERS",		SETWORKERS,		0},
+#  endif
+#  ifdef FORTH_SAMPLER
+	{"SAMPLE-ON",		SAMPLEON,		0},
+	{"SAMPLE-OFF",		SAMPLEOFF,		0},
+	{"SAVE-SAMPLES",	SAVESAMPLES,		0},
+#  endif
+	
+	{NULL,			0,			0}
+};
+
+
+// names of primitives compiled by the system itself, which have no dictionary entries
+primitive_word_t runtime_words[] = {
+	{"(LIT)",		LIT,			0},
+	{"(LITXT)",		LITXT,			0},
+	{"(BRANCH)",		BRANCH,			0},
+	{"(?BRANCH)",		QBRANCH,		0},
+	{"(DO)",		DODO,			0},
+	{"(?DO)",		DOQDO,			0},
+	{"(LOOP)",		DOLOOP,			0},
+	{"(+LOOP)",		DOADDLOOP,		0},
+	{"(TRY)",		DOTRY,			0},
+	{"(PAR-LOOP)",		DOPARLOOP,		0},
+	
+	{NULL,			0,			0}
+};
+
+
+// ============================== Forth state =================================
+
+#ifndef FORTH_NO_CHANNELS
+// channels are shared by all interpreters of the process, channel number is index + 1
+static channel_t *channels[CHANNELS_MAX];
+#endif
+#ifndef FORTH_NO_CHECKPOINTS
+static unsigned ckserials;		// checkpoints taken by all interpreters of the process
+#endif
+
+#ifdef FORTH_THREADS
+__thread forth_t F;
+
+enum par_reduce {
+	PAR_NONE,
+	PAR_SUM,
+	PAR_MIN,
+	PAR_MAX
+};
+
+// worker threads of parallel loops, shared by all interpreters of the process
+static struct {
+	pthread_mutex_t job;			// held by the thread running a parallel loop
+	pthread_mutex_t lock;
+	pthread_cond_t start, done;
+	pthread_mutex_t output;			// workers share the output sink of the caller
+	int nworkers;				// workers used by a loop, 0 - number of processors
+	int nthreads;				// started threads
+	unsigned generation;			// incremented for every loop
+	int active, pending;
+	
+	// current loop
+	const forth_t *master;
+	int xt, lo, chunk, hi, reduce, loopframe;
+	long long budget;			// steps left to the workers, -1 - unlimited
+	struct {
+		int result;
+		int failed;
+		char errormsg[ERROR_MAX];
+	} parts[WORKERS_MAX];
+} pool = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_MUTEX_INITIALIZER};
+#else
+forth_t F;
+#endif
+
+#ifdef FORTH_SAMPLER
+static struct sigaction oldprofaction;
+static int sampling;
+#endif
+
+
+// ============================== Prototypes ==================================
+
+static void core_prims(int prim, int pfa);
+static char *mapped(int a, int size, int write);
+#ifndef FORTH_NO_CHECKPOINTS
+static char *dirty(int a, int size);
+#endif
+#ifndef FORTH_NO_OUTPUT
+static void flushout(int whole);
+#endif
+
+
+// =============================== Functions ==================================
+
+static int endian(void)
+{
+	int x = 1;
+	return *(char *)&x == 1 ? -1 : 1;
+}
+
+#ifndef FORTH_NO_TRACER
+static void traceevent(int type, int arg, int arg2)
+{
+	trace_event_t *e = &F.trace[F.tracecount++ % F.tracecap];
+	
+	e->ts = fth_nanotime();
+	e->type = type;
+	e->arg = arg;
+	e->arg2 = arg2;
+}
+
+
+// closes frames of words abandoned by an error above return stack depth
+static void traceunwind(int depth)
+{
+	int r;
+	
+	for (r = F.rsp; r > depth; r--)
+		traceevent(TE_EXIT, r == F.rsp ? F.running : F.rstack[r].xt, 0);
+}
+
+#  define TRACE(cat, type, arg, arg2) \
+			if (F.tracemask & (cat)) traceevent((type), (arg), (arg2))
+#  define TRACEUNWIND(depth) \
+			if (F.tracemask & FORTH_TRACE_WORDS) traceunwind(depth)
+#else
+#  define TRACE(cat, type, arg, arg2)
+#  define TRACEUNWIND(depth)
+#endif
+
+
+#if !defined(FORTH_NO_TASKS) || !defined(FORTH_NO_RESUMABLE)
+// Context switches copy only the used parts of the stacks
+static void savetask(task_t *t)
+{
+	memcpy(t->stack, F.stack, F.sp * sizeof(int));
+	t->sp = F.sp;
+	memcpy(t->rstack, F.rstack, F.rsp * sizeof(rstack_entry_t));
+	t->rsp = F.rsp;
+	memcpy(t->lstack, F.lstack, F.lsp * sizeof(lstack_entry_t));
+	t->lsp = F.lsp;
+	t->ip = F.ip;
+	t->running = F.running;
+}
+
+
+static void loadstate(const task_t *t)
+{
+	memcpy(F.stack, t->stack, t->sp * sizeof(int));
+	F.sp = t->sp;
+	memcpy(F.rstack, t->rstack, t->rsp * sizeof(rstack_entry_t));
+	F.rsp = t->rsp;
+	memcpy(F.lstack, t->lstack, t->lsp * sizeof(lstack_entry_t));
+	F.lsp = t->lsp;
+	F.ip = t->ip;
+	F.running = t->running;
+}
+#endif
+
+
+#ifndef FORTH_NO_TASKS
+static void loadtask(int task)
+{
+	loadstate(&F.tasks[task]);
+	F.task = task;
+}
+
+
+static void linktask(int task)
+{
+	task_t *t = &F.tasks[task], *cur = &F.tasks[F.task];
+	
+	t->prev = F.task;
+	t->next = cur->next;
+	F.tasks[cur->next].prev = task;
+	cur->next = task;
+}
+
+
+static void unlinktask(int task)
+{
+	task_t *t = &F.tasks[task];
+	
+	F.tasks[t->prev].next = t->next;
+	F.tasks[t->next].prev = t->prev;
+	t->next = t->prev = -1;
+}
+
+
+// Stops the current task and switches to the next one; task 0 is never stopped
+static void stoptask(void)
+{
+	int next = F.tasks[F.task].next;
+	
+	check(F.errhandlers != 1, "task can't be stopped inside TRY or nested call");
+	unlinktask(F.task);
+	loadtask(next);
+}
+#endif
+
+
+static void rpush(void)
+{
+	check(F.rsp >= RSTACK_SIZE, "return stack overflow");
+	F.rstack[F.rsp].ip = F.ip;
+	F.rstack[F.rsp].xt = F.running;
+	F.rsp++;
+	PEAK(F.stats.rsppeak, F.rsp);
+}
+
+
+static void rpop(void)
+{
+	check(F.rsp <= 0, "return stack underflow");
+	--F.rsp;
+	F.ip = F.rstack[F.rsp].ip;
+	F.running = F.rstack[F.rsp].xt;
+#ifndef FORTH_NO_TASKS
+	if (F.rsp == 0 && F.task)	// the task has left the definition that ACTIVATEd it
+		stoptask();
+#endif
+}
+
+
+static void lpush(int index, int limit, int leave)
+{
+	check(F.lsp >= LSTACK_SIZE, "loop stack overflow");
+	F.lstack[F.lsp].index = index;
+	F.lstack[F.lsp].limit = limit;
+	F.lstack[F.lsp].leave = leave;
+	F.lstack[F.lsp].xt = F.running;
+	F.lsp++;
+	PEAK(F.stats.lsppeak, F.lsp);
+}
+
+
+static void lpop(void)
+{
+	check(F.lsp <= 0, "loop stack underflow");
+	F.lsp--;
+}
+
+
+static void cfpush(enum cftype type, int ref)
+{
+	check(F.cfsp >= CFSTACK_SIZE, "too nested control structures");
+	F.cfstack[F.cfsp].type = type;
+	F.cfstack[F.cfsp].ref = ref;
+	F.cfsp++;
+	PEAK(F.stats.cfsppeak, F.cfsp);
+}
+
+
+static int cfpop(enum cftype required)
+{
+	check(F.cfsp <= 0, "unbalanced control structure");
+	F.cfsp--;
+	check(F.cfstack[F.cfsp].type != required, "unbalanced control structure");
+	return F.cfstack[F.cfsp].ref;
+}
+
+
+static enum cftype cfpeek(void)
+{
+	check(F.cfsp <= 0, "unbalanced control structure");
+	return F.cfstack[F.cfsp - 1].type;
+}
+
+
+#ifndef FORTH_NO_TRACER
+static const char *areanames[] = {"unknown", "code", "data", "dictionary", "names", "code index", "tasks", "resumables"};
+
+static int areaid(void **area)
+{
+	if (area == (void **)&F.code)
+		return 1;
+	if (area == (void **)&F.data)
+		return 2;
+	if (area == (void **)&F.dict)
+		return 3;
+	if (area == (void **)&F.names)
+		return 4;
+	if (area == (void **)&F.codeindex)
+		return 5;
+#  ifndef FORTH_NO_TASKS
+	if (area == (void **)&F.tasks)
+		return 6;
+#  endif
+#  ifndef FORTH_NO_RESUMABLE
+	if (area == (void **)&F.resumables)
+		return 7;
+#  endif
+	return 0;
+}
+#endif
+
+
+#ifndef FORTH_NO_OUTPUT
+// Writes digits of u in the given base backwards, ending just before end
+static char *formatnumber(char *end, unsigned u, int base)
+{
+	do {
+		*--end = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ"[u % base];
+		u /= base;
+	} while (u);
+	return end;
+}
+
+
+static void hold(char c)
+{
+	check(F.holdp <= 0, "pictured numeric output overflow");
+	F.hold[--F.holdp] = c;
+}
+#endif
+
+
+#ifndef FORTH_NO_CLONES
+#  ifdef FORTH_THREADS
+#    define REFADD(r, n)	__atomic_add_fetch((r), (n), __ATOMIC_ACQ_REL)
+#    define REFGET(r)		__atomic_load_n((r), __ATOMIC_ACQUIRE)
+#  else
+#    define REFADD(r, n)	(*(r) += (n))
+#    define REFGET(r)		(*(r))
+#  endif
+#  define unshare(area, cap)	check(!reserve((void **)&(area), &(cap), 0, 0), "unable to copy shared area")
+
+// Returns pointer to the reference counter of an area that can be shared with clones
+static int **arearefs(void **area)
+{
+	if (area == (void **)&F.code)
+		return &F.coderefs;
+	if (area == (void **)&F.dict)
+		return &F.dictrefs;
+	if (area == (void **)&F.names)
+		return &F.namesrefs;
+	if (area == (void **)&F.codeindex)
+		return &F.codeindexrefs;
+	return NULL;
+}
+
+
+// Drops a reference to an area, freeing it with the last one
+static void release(void *area, int **refs)
+{
+	if (*refs && REFADD(*refs, -1) > 0) {
+		*refs = NULL;
+		return;
+	}
+	free(*refs);
+	*refs = NULL;
+	free(area);
+}
+#else
+#  define unshare(area, cap)
+#  define release(area, refs)	free(area)
+#endif
+
+
+static int reserve(void **area, int *size, int p, int required)
+{
+	void *newarea;
+	int newsize = *size;
+#ifndef FORTH_NO_CLONES
+	int **refs = arearefs(area);
+	
+	// the first write to an area shared with clones copies it, unless they are all gone
+	if (refs && *refs) {
+#  ifdef FORTH_THREADS
+		if (F.worker)
+			return 0;
+#  endif
+		if (REFGET(*refs) > 1) {
+			while (p + required > newsize)
+				newsize *= 2;
+			newarea = malloc(newsize);
+			if (!newarea)
+				return 0;
+			memcpy(newarea, *area, *size);
+			F.stats.copied += *size;
+			release(*area, refs);
+			*area = newarea;
+			*size = newsize;
+			(*(char **)area)[newsize - 1] = 0;
+			TRACE(FORTH_TRACE_MEMORY, TE_GROW, areaid(area), newsize);
+			return 1;
+		}
+		free(*refs);
+		*refs = NULL;
+	}
+#endif
+	
+	while (p + required > newsize) {
+#ifdef FORTH_THREADS
+		if (F.worker)		// areas are shared with the other workers and can't move
+			return 0;
+#endif
+		newsize *= 2;
+		newarea = realloc(*area, newsize);
+		if (!newarea)
+			return 0;
+		F.stats.reallocs++;
+		F.stats.copied += *size;
+		*area = newarea;
+		*size = newsize;
+		(*(char **)area)[newsize - 1] = 0;
+		TRACE(FORTH_TRACE_MEMORY, TE_GROW, areaid(area), newsize);
+	}
+	return 1;
+}
+
+
+#ifndef FORTH_NO_CHECKPOINTS
+// Marks data blocks below the checkpoint as written, returns pointer to the data
+static char *dirty(int a, int size)
+{
+	int b = a / DIRTY_BLOCK, last = ((a + size < F.ckdp ? a + size : F.ckdp) - 1) / DIRTY_BLOCK;
+	
+	for (; a < F.ckdp && b <= last; b++)
+		if (!F.dirtymap[b]) {
+			F.dirtymap[b] = 1;
+			F.dirtyblocks[F.ndirty++] = b;
+		}
+	return &F.data[a];
+}
+
+
+static void journal(int a, int x)
+{
+	check(!reserve((void **)&F.patches, &F.patchescap, F.patchp * sizeof(patch_entry_t), sizeof(patch_entry_t)), "unable to expand checkpoint journal");
+	F.patches[F.patchp].a = a;
+	F.patches[F.patchp].x = x;
+	F.patchp++;
+}
+
+
+static void dropcheckpoint(void)
+{
+	free(F.ckdata);
+	free(F.dirtymap);
+	free(F.dirtyblocks);
+	free(F.patches);
+	F.ckdata = NULL;
+	F.dirtymap = NULL;
+	F.dirtyblocks = NULL;
+	F.patches = NULL;
+	F.ndirty = F.patchp = F.patchescap = 0;
+}
+#endif
+
+
+// Prepares compiled code cell a to be changed in place
+static void patchcode(int a)
+{
+	unshare(F.code, F.codecap);
+#ifndef FORTH_NO_CHECKPOINTS
+	if (F.dirtymap && a < F.ckcp)
+		journal(a, F.code[a]);
+#endif
+}
+
+
+// Prepares flags of dictionary entry w to be changed in place
+static void patchflags(int w)
+{
+	unshare(F.dict, F.dictcap);
+#ifndef FORTH_NO_CHECKPOINTS
+	if (F.dirtymap && w < F.ckdictp)
+		journal(-w, F.dict[w].flags);
+#endif
+}
+
+
+static void compile(int x)
+{
+	checkworker();
+	check(!reserve((void **)&F.code, &F.codecap, F.cp * sizeof(int), sizeof(int)), "unable to expand code area");
+	F.code[F.cp++] = x;
+	PEAK(F.stats.cppeak, F.cp);
+}
+
+
+static void dcompile(int x)
+{
+	checkworker();
+	check(!reserve((void **)&F.data, &F.datacap, F.dp, sizeof(int)), "unable to expand data area");
+#ifdef FORTH_ALIGNMENT_HACK
+	memcpy(&F.data[F.dp], &x, sizeof(int));
+#else
+	*(int *)&F.data[F.dp] = x;
+#endif
+	F.dp += sizeof(int);
+	PEAK(F.stats.dppeak, F.dp);
+}
+
+
+static void ccompile(int c)
+{
+	checkworker();
+	check(!reserve((void **)&F.data, &F.datacap, F.dp, 1), "unable to expand data area");
+	F.data[F.dp++] = c;
+	PEAK(F.stats.dppeak, F.dp);
+}
+
+
+static void scompile(const char *s, int size)
+{
+	int escape = 0;
+	
+	while (size) {
+		switch (*s) {
+			case '\\':
+				if (escape) {
+					ccompile(*s);
+					escape = 0;
+				} else {
+					escape = 1;
+				}
+				break;
+			case 'n':
+				if (escape) {
+					ccompile('\n');
+					escape = 0;
+				} else {
+					ccompile(*s);
+				}
+				break;
+			case 't':
+				if (escape) {
+					ccompile('\t');
+					escape = 0;
+				} else {
+					ccompile(*s);
+				}
+				break;
+			case 'r':
+				if (escape) {
+					ccompile('\r');
+					escape = 0;
+				} else {
+					ccompile(*s);
+				}
+				break;
+			case 'b':
+				if (escape) {
+					ccompile('\b');
+					escape = 0;
+				} else {
+					ccompile(*s);
+				}
+				break;
+			default:
+				ccompile(*s);
+				escape = 0;
+				break;
+		}
+		s++, size--;
+	}
+	ccompile('\0');
+}
+
+
+static void indexcode(int xt, int word)
+{
+	int i = F.codeindexp;
+	
+	check(!reserve((void **)&F.codeindex, &F.codeindexcap, F.codeindexp * sizeof(codeindex_t), sizeof(codeindex_t)), "unable to expand code index");
+	while (i > 0 && F.codeindex[i - 1].xt > xt) {
+		F.codeindex[i] = F.codeindex[i - 1];
+		i--;
+	}
+	F.codeindex[i].xt = xt;
+	F.codeindex[i].word = word;
+	F.codeindexp++;
+}
+
+
+// rebuilds code index after dictionary is replaced; { } blocks are not saved with the system and are lost
+static void reindex(void)
+{
+	int i;
+	
+	F.codeindexp = 0;
+	for (i = 1; i < F.dictp; i++)
+		if (F.dict[i].xt < F.cp)	// a loaded program may have less code than the dictionary describes
+			indexcode(F.dict[i].xt, i);
+	indexcode(F.lit_xt, 0);
+	indexcode(F.branch_xt, 0);
+	indexcode(F.qbranch_xt, 0);
+	indexcode(F.dodo_xt, 0);
+	indexcode(F.doqdo_xt, 0);
+	indexcode(F.doloop_xt, 0);
+	indexcode(F.doaddloop_xt, 0);
+	indexcode(F.dotry_xt, 0);
+	indexcode(F.litxt_xt, 0);
+	indexcode(F.parloop_xt, 0);
+}
+
+
+// finds the definition containing code address a, returns its index entry or NULL
+static codeindex_t *codeowner(int a)
+{
+	int lo = 0, hi = F.codeindexp - 1, mid;
+	
+	if (a <= 0 || a >= F.cp || hi < 0 || F.codeindex[0].xt > a)
+		return NULL;
+	
+	while (lo < hi) {
+		mid = (lo + hi + 1) / 2;
+		if (F.codeindex[mid].xt <= a)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	return &F.codeindex[lo];
+}
+
+
+static const char *ownername(codeindex_t *c)
+{
+	int i;
+	
+	if (c->word)
+		return &F.names[F.dict[c->word].name];
+	
+	for (i = 0; runtime_words[i].name; i++)
+		if (runtime_words[i].code == F.code[c->xt])
+			return runtime_words[i].name;
+	
+	return "{ }";
+}
+
+
+static const char *xtname(int xt)
+{
+	codeindex_t *c = codeowner(xt);
+	
+	if (!c || c->xt != xt)
+		return NULL;
+	return ownername(c);
+}
+
+
+#ifndef FORTH_NO_PROFILER
+static profile_counter_t *profiled(int xt)
+{
+	if (xt >= F.profilesize) {
+		int size = F.codecap / sizeof(int);
+		profile_counter_t *profile = (profile_counter_t *)realloc(F.profile, size * sizeof(profile_counter_t));
+		
+		check(!profile, "unable to expand profiler data");
+		memset(profile + F.profilesize, 0, (size - F.profilesize) * sizeof(profile_counter_t));
+		F.profile = profile;
+		F.profilesize = size;
+	}
+	return &F.profile[xt];
+}
+
+
+// drops shadow frames left above return stack depth by errors or by DOES>
+static void profileunwind(int depth)
+{
+	while (F.psp > depth) {
+		if (F.pstack[F.psp].xt)
+			F.profile[F.pstack[F.psp].xt].active--;
+		F.psp--;
+	}
+}
+
+
+// called after return stack push for colon and DOES> words
+static void profileenter(void)
+{
+	profileunwind(F.rsp - 1);
+	while (F.psp < F.rsp - 1)
+		F.pstack[++F.psp].xt = 0;	// frames entered before profiling was on
+	F.psp = F.rsp;
+	F.pstack[F.psp].xt = F.running;
+	F.pstack[F.psp].children = 0;
+	profiled(F.running)->active++;
+	F.pstack[F.psp].start = fth_nanotime();
+}
+
+
+// called before return stack pop
+static void profileexit(void)
+{
+	long long elapsed;
+	profile_counter_t *p;
+	
+	profileunwind(F.rsp);
+	if (F.psp != F.rsp || F.pstack[F.psp].xt != F.running || !F.running)
+		return;
+	
+	elapsed = fth_nanotime() - F.pstack[F.psp].start;
+	p = &F.profile[F.running];
+	if (--p->active == 0)
+		p->inclusive += elapsed;	// outermost frame of recursive word
+	p->exclusive += elapsed - F.pstack[F.psp].children;
+	F.psp--;
+	if (F.psp > 0)
+		F.pstack[F.psp].children += elapsed;
+}
+
+#  define PROFILE(hook)	if (F.profiling) hook
+#else
+#  define PROFILE(hook)
+#endif
+
+
+#ifdef FORTH_OPSTATS
+static int opindex(int prim)
+{
+	if ((unsigned)prim < OPSTATS_APP_MAX)
+		return prim;
+	if (prim >= CORE_PRIM_FIRST && prim < NUM_CORE_PRIM)
+		return OPSTATS_APP_MAX + prim - CORE_PRIM_FIRST;
+	return NUM_OPSTATS - 1;
+}
+
+
+static int opcode(int idx)
+{
+	if (idx < OPSTATS_APP_MAX)
+		return idx;
+	if (idx < NUM_OPSTATS - 1)
+		return CORE_PRIM_FIRST + idx - OPSTATS_APP_MAX;
+	return -1;
+}
+
+
+static void opcount(int prim)
+{
+	int idx = opindex(prim);
+	
+	F.opstats[idx]++;
+	if (F.lastop >= 0)
+		F.opstats[NUM_OPSTATS + F.lastop * NUM_OPSTATS + idx]++;
+	F.lastop = idx;
+}
+
+#  define OPSTATS(prim)	opcount(prim)
+#else
+#  define OPSTATS(prim)
+#endif
+
+
+// Inner interpreter: runs the threaded code until the definition at return stack depth orsp returns
+static void run(int orsp)
+{
+	int xt, prim;
+	
+	while (orsp < F.rsp) {
+		xt = F.code[F.ip++];
+		prim = F.code[xt];
+		PROFILE(profiled(xt)->calls++);
+		OPSTATS(prim);
+		core_prims(prim, xt + 1);
+	}
+}
+
+
+static void execute(int xt)
+{
+	int prim = F.code[xt];
+	int orsp = F.rsp;
+	
+	PROFILE(profiled(xt)->calls++);
+	OPSTATS(prim);
+	core_prims(prim, xt + 1);
+	run(orsp);
+}
+
+
+#ifndef FORTH_NO_RESUMABLE
+#  define RESUMABLE_RUNNING	2
+#  define RESUMABLE_FREE	3
+
+// Saves the state of the resumed execution and returns from fth_resume() with FORTH_YIELDED
+static void suspend(void)
+{
+	resumable_t *r;
+	
+	check(!F.resuming, "YIELD used outside of resumable execution");
+	check(F.errhandlers != F.resumelevel, "YIELD is not allowed inside TRY or nested call");
+	r = &F.resumables[F.resuming];
+	savetask(&r->state);
+	r->status = FORTH_YIELDED;
+	longjmp(F.errjmp, 1);
+}
+#endif
+
+
+#ifndef FORTH_NO_BUDGET
+// Called when the fuel counter runs out: checks the deadline and takes the next chunk of the budget
+static void refuel(int pfa)
+{
+	int chunk = FUEL_CHUNK;
+	
+	F.fuel = -1;			// out of fuel until the budget allows more
+	CHECKDEADLINE();
+	if (F.budget >= 0) {
+#  ifndef FORTH_NO_RESUMABLE
+		// the step limit of fth_resume() suspends the execution before the instruction taking the step,
+		// inside TRY or nested call the check is repeated at every step until it can be done
+		if (F.budget == 0 && F.stepyield) {
+			if (F.errhandlers == F.resumelevel && F.running && F.code[F.ip - 1] == pfa - 1) {
+				F.ip--;
+				suspend();
+			}
+			return;
+		}
+#  endif
+#  ifdef FORTH_THREADS
+		// workers of a parallel loop take their chunks from the caller's budget
+		if (F.worker) {
+			long long left = __atomic_load_n(&pool.budget, __ATOMIC_RELAXED);
+			
+			do {
+				check(left <= 0, "execution budget exhausted");
+				chunk = left < FUEL_CHUNK ? (int)left : FUEL_CHUNK;
+			} while (!__atomic_compare_exchange_n(&pool.budget, &left, left - chunk, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+			F.fuel = chunk - 1;
+			return;
+		}
+#  endif
+		check(F.budget == 0, "execution budget exhausted");
+		if (chunk > F.budget)
+			chunk = (int)F.budget;
+		F.budget -= chunk;
+	}
+	F.fuel = chunk - 1;
+}
+#endif
+
+
+static void create(const char *name, int flags, int prim)
+{
+	int name_size = strlen(name) + 1;
+	
+	checkworker();
+	check(!reserve((void **)&F.dict, &F.dictcap, F.dictp * sizeof(word_t), sizeof(word_t)), "unable to expand dictionary area while creating %s", name);
+	check(!reserve((void **)&F.names, &F.namescap, F.namesp, name_size), "unable to expand names area while creating %s", name);
+	indexcode(F.cp, F.dictp);
+	patchcode(F.current);
+	F.dict[F.dictp].link = F.code[F.current];
+	F.code[F.current] = F.dictp;
+	F.dict[F.dictp].flags = flags;
+	F.dict[F.dictp].xt = F.cp;
+	compile(prim);
+	F.dict[F.dictp].name = F.namesp;
+	strcpy(&F.names[F.namesp], name);
+	F.namesp += name_size;
+	F.dictp++;
+	PEAK(F.stats.namesppeak, F.namesp);
+	PEAK(F.stats.dictppeak, F.dictp);
+}
+
+
+static int getword(char sep)
+{
+	char *wordp = F.word;
+	
+	while (SOURCELEFT && ISSEP(sep, CURCHAR))
+		F.intp++;
+	
+	if (!SOURCELEFT)
+		return 0;
+	
+	while (SOURCELEFT && !ISSEP(sep, CURCHAR)) {
+		if (wordp < F.word + WORD_MAX - 1)
+			*wordp++ = CURCHAR;
+		F.intp++;
+	}
+	
+	*wordp = '\0';
+	
+	if (SOURCELEFT)
+		F.intp++;
+	
+	return 1;
+}
+
+
+static int parse(char sep, int *pstart, int *plength)
+{
+	int start = F.intp, length = 0;
+	int escape = 0;
+	
+	if (!SOURCELEFT)
+		return 0;
+	
+	while (SOURCELEFT) {
+		if (CURCHAR == '\\') {
+			F.intp++, length++;
+			escape = !escape;
+		} else if (ISSEP(sep, CURCHAR)) {
+			if (escape) {
+				F.intp++, length++;
+				escape = 0;
+			} else {
+				break;
+			}
+		} else {
+			F.intp++, length++;
+			escape = 0;
+		}
+	}
+	
+	if (!SOURCELEFT)
+		return 0;
+	
+	F.intp++;
+		
+	if (pstart)
+		*pstart = start;
+	if (plength)
+		*plength = length;
+	
+	return 1;
+}
+
+
+static word_t *find(const char *word)
+{
+	int p;		// dict address of next word to check
+	int voc = F.context;	// pfa of vocabulary
+	
+	do {
+		for (p = F.code[voc]; p; p = F.dict[p].link)
+			if (!ISSET(F.dict[p].flags, SMUDGED) && strcasecmp(&F.names[F.dict[p].name], word) == 0)
+				return &F.dict[p];
+		voc = F.code[voc + 1];
+	} while (voc);
+	
+	/* Uncomment to enable CURRENT-vocabulary search
+	if (F.context == F.current)
+		return NULL;
+	
+	voc = F.current;
+	do {
+		for (p = F.code[voc]; p; p = F.dict[p].link)
+			if (!ISSET(F.dict[p].flags, SMUDGED) && strcasecmp(&F.names[F.dict[p].name], word) == 0)
+				return &F.dict[p];
+		voc = F.code[voc + 1];
+	} while (voc);
+	//*/
+	
+	return NULL;
+}
+
+
+static int toliteral(int *n)
+{
+	int ret, read;
+	
+	if (sscanf(F.word, "%d%n", &ret, &read) == 1 && read == strlen(F.word)) {
+		if (n)
+			*n = ret;
+		return 1;
+	}
+	
+	if (sscanf(F.word, "0%*[Xx]%x%n", &ret, &read) == 1 && read == strlen(F.word)) {
+		if (n)
+			*n = ret;
+		return 1;
+	}
+	
+	return 0;
+}
+
+
+static void do_interpret(void)
+{
+	int n;
+	word_t *w;
+	
+	while (SOURCELEFT) {
+		if (!getword(' '))
+			break;
+		w = find(F.word);
+		if (w) {
+			if (F.state == 0 || ISSET(w->flags, IMMEDIATE))
+				execute(w->xt);
+			else
+				compile(w->xt);
+		} else if (F.app_notfound && F.app_notfound(F.word)) {
+			// app_notfound() has already done the job
+		} else if (toliteral(&n)) {
+			if (F.state) {
+				compile(F.lit_xt);
+				compile(n);
+			} else {
+				push(n);
+			}
+		} else {
+			error("%s ?", F.word);
+		}
+	}
+}
+
+
+#ifndef FORTH_NO_SAVES
+static void saveprogram(const char *fname, int entry)
+{
+	char sig[4] = {PROGRAM_MARK, endian(), sizeof(int), FORMAT_VERSION};
+	FILE *f;
+	
+	f = fopen(fname, "wb");
+	TRACE(FORTH_TRACE_IO, TE_IO, IO_SAVEPROGRAM, 0);
+	check(!f, "save error: %s", strerror(errno));
+	
+	check(fwrite(sig, 1, 4, f) < 4, "save error: %s", strerror(errno));
+	check(fwrite(&entry, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
+	check(fwrite(&F.cp, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
+	check(fwrite(F.code, sizeof(int), F.cp, f) < F.cp, "save error: %s", strerror(errno));
+	check(fwrite(&F.dp, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
+	check(fwrite(F.data, 1, F.dp, f) < F.dp, "save error: %s", strerror(errno));
+	
+	check(fwrite(&F.lit_xt, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
+	check(fwrite(&F.exit_xt, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
+	check(fwrite(&F.branch_xt, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
+	check(fwrite(&F.qbranch_xt, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
+	check(fwrite(&F.dodo_xt, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
+	check(fwrite(&F.doqdo_xt, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
+	check(fwrite(&F.doloop_xt, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
+	check(fwrite(&F.doaddloop_xt, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
+	check(fwrite(&F.codecomma_xt, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
+	check(fwrite(&F.store_xt, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
+	check(fwrite(&F.dotry_xt, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
+	check(fwrite(&F.litxt_xt, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
+	check(fwrite(&F.parloop_xt, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
+	
+	fclose(f);
+	TRACE(FORTH_TRACE_IO, TE_IOEND, IO_SAVEPROGRAM, 0);
+}
+
+
+// kinds of code cells found by shakeprogram()
+#define SHAKE_DEAD	0		// unreachable, dropped from image
+#define SHAKE_RAW	1		// copied as is
+#define SHAKE_ADDR	2		// code address, relocated
+
+#define shakeword(xt) \
+			if ((xt) > 0 && (xt) < F.cp && !kind[xt]) todo[ntodo++] = (xt)
+#define shakethread(ip) \
+			if ((ip) > 0 && (ip) < F.cp && !kind[ip]) todo[ntodo++] = -(ip)
+// errors are raised after freeing the buffers
+#define shakecheck(cond, ...) \
+			if (cond) { snprintf(msg, ERROR_MAX, __VA_ARGS__); goto fail; }
+
+static int shakeprogram(const char *fname, int entry)
+{
+	char sig[4] = {PROGRAM_MARK, endian(), sizeof(int), FORMAT_VERSION};
+	int core[13] = {F.lit_xt, F.exit_xt, F.branch_xt, F.qbranch_xt, F.dodo_xt, F.doqdo_xt, F.doloop_xt, F.doaddloop_xt, F.codecomma_xt, F.store_xt, F.dotry_xt, F.litxt_xt, F.parloop_xt};
+	char *kind, msg[ERROR_MAX];
+	int *map, *todo, *code = NULL;
+	int ntodo = 0, cp, a, i;
+	FILE *f = NULL;
+	
+	kind = (char *)calloc(F.cp, 1);
+	map = (int *)malloc(F.cp * sizeof(int));
+	todo = (int *)malloc((F.cp + 16) * sizeof(int));
+	shakecheck(!kind || !map || !todo, "unable to allocate memory for program shaking");
+	
+	// mark cells reachable from the entry point and the core xt-s
+	kind[0] = SHAKE_RAW;
+	shakeword(entry);
+	for (i = 0; i < 13; i++)
+		shakeword(core[i]);
+	
+	while (ntodo) {
+		a = todo[--ntodo];
+		if (a > 0) {
+			// definition header and parameters
+			if (kind[a])
+				continue;
+			kind[a] = SHAKE_RAW;
+			switch (F.code[a]) {
+				case ENTER:
+					shakethread(a + 1);
+					break;
+				case DOCONSTANT:
+				case DOVALUE:
+					kind[a + 1] = SHAKE_RAW;
+					break;
+				case DOVARIABLE:
+					kind[a + 1] = SHAKE_RAW;
+					kind[a + 2] = SHAKE_RAW;
+					break;
+				case DODOES:
+					kind[a + 1] = SHAKE_RAW;
+					kind[a + 2] = SHAKE_ADDR;
+					shakethread(F.code[a + 2]);
+					break;
+				case DOVOCABULARY:
+					kind[a + 1] = SHAKE_RAW;
+					kind[a + 2] = SHAKE_ADDR;
+					shakeword(F.code[a + 2] - 1);
+					break;
+			}
+		} else {
+			// threaded code up to EXIT or unconditional branch
+			for (a = -a; a > 0 && a < F.cp && !kind[a]; ) {
+				int xt = F.code[a];
+				kind[a++] = SHAKE_ADDR;
+				if (xt <= 0 || xt >= F.cp)
+					break;
+				shakeword(xt);
+				switch (F.code[xt]) {
+					case LIT:
+						kind[a++] = SHAKE_RAW;
+						break;
+					case LITXT:
+					case DOTRY:
+						kind[a] = SHAKE_ADDR;
+						shakeword(F.code[a]);
+						a++;
+						break;
+					case QBRANCH:
+					case DODO:
+					case DOQDO:
+					case DOLOOP:
+					case DOADDLOOP:
+						kind[a] = SHAKE_ADDR;
+						shakethread(F.code[a]);
+						a++;
+						break;
+					case BRANCH:
+						kind[a] = SHAKE_ADDR;
+						a = F.code[a];
+						break;
+					case EXIT:
+						a = 0;
+						break;
+				}
+			}
+		}
+	}
+	
+	// compact and relocate
+	for (cp = 0, a = 0; a < F.cp; a++) {
+		map[a] = cp;
+		if (kind[a])
+			cp++;
+	}
+	
+	code = (int *)malloc(cp * sizeof(int));
+	shakecheck(!code, "unable to allocate memory for program shaking");
+	for (a = 0; a < F.cp; a++)
+		if (kind[a] == SHAKE_RAW) {
+			code[map[a]] = F.code[a];
+		} else if (kind[a] == SHAKE_ADDR) {
+			shakecheck(F.code[a] < 0 || F.code[a] >= F.cp || !kind[F.code[a]], "unable to relocate code address %d at %d", F.code[a], a);
+			code[map[a]] = map[F.code[a]];
+		}
+	entry = map[entry];
+	for (i = 0; i < 13; i++)
+		core[i] = map[core[i]];
+	
+	free(kind);
+	free(map);
+	free(todo);
+	kind = NULL;
+	map = todo = NULL;
+	
+	f = fopen(fname, "wb");
+	TRACE(FORTH_TRACE_IO, TE_IO, IO_SHAKEPROGRAM, 0);
+	shakecheck(!f, "save error: %s", strerror(errno));
+	
+	shakecheck(fwrite(sig, 1, 4, f) < 4, "save error: %s", strerror(errno));
+	shakecheck(fwrite(&entry, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
+	shakecheck(fwrite(&cp, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
+	shakecheck(fwrite(code, sizeof(int), cp, f) < cp, "save error: %s", strerror(errno));
+	shakecheck(fwrite(&F.dp, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
+	shakecheck(fwrite(F.data, 1, F.dp, f) < F.dp, "save error: %s", strerror(errno));
+	shakecheck(fwrite(core, sizeof(int), 13, f) < 13, "save error: %s", strerror(errno));
+	
+	fclose(f);
+	TRACE(FORTH_TRACE_IO, TE_IOEND, IO_SHAKEPROGRAM, 0);
+	free(code);
+	return (F.cp - cp) * sizeof(int);
+	
+fail:
+	free(kind);
+	free(map);
+	free(todo);
+	free(code);
+	if (f)
+		fclose(f);
+	error("%s", msg);
+	return 0;
+}
+#endif
+
+
+static void markfwd(enum cftype type)
+{
+	cfpush(type, F.cp);
+	compile(0);
+}
+
+
+static void resolvefwd(enum cftype required)
+{
+	int a = cfpop(required);
+	
+	patchcode(a);
+	F.code[a] = F.cp;
+}
+
+
+static void markback(enum cftype type)
+{
+	cfpush(type, F.cp);
+}
+
+
+static void resolveback(enum cftype required)
+{
+	compile(cfpop(required));
+}
+
+
+#ifndef FORTH_NO_ATOMICS
+// Atomic operations need naturally aligned cells even where plain @ and ! don't
+static int *atomiccell(int a, int write)
+{
+	int *p = (int *)dataarea(a, sizeof(int), write);
+	
+	check((size_t)p % sizeof(int) != 0, "unaligned atomic access at %d (use ALIGN before allocating the cell)", a);
+	return p;
+}
+#endif
+
+
+#ifndef FORTH_NO_CHANNELS
+static channel_t *channel(int ch)
+{
+	channel_t *c;
+	
+	check(ch <= 0 || ch > CHANNELS_MAX || !(c = __atomic_load_n(&channels[ch - 1], __ATOMIC_ACQUIRE)), "invalid channel %d", ch);
+	return c;
+}
+
+
+// Returns true if a blocked channel primitive can let other tasks run: it must be called from
+// threaded code, so that it is executed again with the arguments pushed back
+static int yieldable(int pfa)
+{
+#ifndef FORTH_NO_TASKS
+	return F.tasks && F.tasks[F.task].next != F.task && F.errhandlers == 1 && F.running && F.code[F.ip - 1] == pfa - 1;
+#else
+	return 0;
+#endif
+}
+
+
+static void yield(void)
+{
+#ifndef FORTH_NO_TASKS
+	CHECKDEADLINE();
+	F.ip--;
+	fth_pause();
+#endif
+}
+
+
+// Waits for other threads: spins a while, then yields the processor and finally sleeps
+static void backoff(int *spins)
+{
+	if (++*spins < 64)
+		return;
+	if ((*spins & 63) == 0)
+		CHECKDEADLINE();
+#ifdef _WIN32
+	Sleep(*spins < 1024 ? 0 : 1);
+#else
+	{
+		struct timespec ts = {0, *spins < 1024 ? 0 : 50000};
+		nanosleep(&ts, NULL);
+	}
+#endif
+}
+#endif
+
+
+#ifdef FORTH_REACTOR
+// Returns result of a non-blocking system call, -1 if it would block
+static int nonblocking(int ret, const char *what)
+{
+	check(ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK, "%s error: %s", what, strerror(errno));
+	return ret < 0 ? -1 : ret;
+}
+
+
+static int unixsocket(int a, struct sockaddr_un *addr)
+{
+	int length = fth_length(a), fd;
+	
+	check(length >= (int)sizeof(addr->sun_path), "socket path is too long");
+	memset(addr, 0, sizeof(*addr));
+	addr->sun_family = AF_UNIX;
+	memcpy(addr->sun_path, dataarea(a, length, 0), length);
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	check(fd < 0, "socket error: %s", strerror(errno));
+	return fd;
+}
+
+
+// Sets callbacks of a descriptor and its epoll interest list
+static void watch(int fd, int readxt, int writext)
+{
+	struct epoll_event ev;
+	reactor_watch_t *w;
+	int was, op;
+	
+	check(fd < 0, "invalid file descriptor %d", fd);
+	if (readxt)
+		checkcode(readxt);
+	if (writext)
+		checkcode(writext);
+	if (F.epollfd < 0) {
+		F.epollfd = epoll_create1(EPOLL_CLOEXEC);
+		check(F.epollfd < 0, "epoll error: %s", strerror(errno));
+	}
+	if (!F.watches) {
+		F.watches = (reactor_watch_t *)calloc(64, sizeof(reactor_watch_t));
+		check(!F.watches, "unable to allocate event callbacks");
+		F.watchescap = 64 * sizeof(reactor_watch_t);
+	}
+	if ((fd + 1) * (int)sizeof(reactor_watch_t) > F.watchescap) {
+		int old = F.watchescap;
+		check(!reserve((void **)&F.watches, &F.watchescap, 0, (fd + 1) * sizeof(reactor_watch_t)), "unable to allocate event callbacks");
+		memset((char *)F.watches + old, 0, F.watchescap - old);
+	}
+	
+	w = &F.watches[fd];
+	was = w->readxt || w->writext;
+	w->readxt = readxt;
+	w->writext = writext;
+	ev.events = (readxt ? EPOLLIN : 0) | (writext ? EPOLLOUT : 0);
+	ev.data.fd = fd;
+	if (!was && !ev.events)
+		return;
+	op = !was ? EPOLL_CTL_ADD : ev.events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
+	if (epoll_ctl(F.epollfd, op, fd, &ev) < 0) {
+		w->readxt = w->writext = 0;
+		if (was)
+			F.nwatches--;
+		error("epoll error: %s", strerror(errno));
+	}
+	F.nwatches += !was - !ev.events;
+}
+
+
+static void unwatch(int fd)
+{
+	if (F.watches && fd >= 0 && (fd + 1) * (int)sizeof(reactor_watch_t) <= F.watchescap && (F.watches[fd].readxt || F.watches[fd].writext))
+		watch(fd, 0, 0);
+}
+
+
+static int addtimer(int xt, int ms, int period)
+{
+	reactor_timer_t *t;
+	
+	checkcode(xt);
+	check(ms < 0, "invalid timer interval %d", ms);
+	if (!F.timers) {
+		F.timers = (reactor_timer_t *)malloc(16 * sizeof(reactor_timer_t));
+		check(!F.timers, "unable to allocate timer");
+		F.timerscap = 16 * sizeof(reactor_timer_t);
+	}
+	check(!reserve((void **)&F.timers, &F.timerscap, F.timerp * sizeof(reactor_timer_t), sizeof(reactor_timer_t)), "unable to allocate timer");
+	t = &F.timers[F.timerp++];
+	t->due = fth_nanotime() + ms * 1000000LL;
+	t->period = period;
+	t->xt = xt;
+	t->id = ++F.lasttimer;
+	return t->id;
+}
+
+
+static void canceltimer(int id)
+{
+	int i;
+	
+	for (i = 0; i < F.timerp; i++)
+		if (F.timers[i].id == id) {
+			F.timers[i] = F.timers[--F.timerp];
+			return;
+		}
+}
+
+
+// Index of the timer due first, -1 if there are no timers
+static int nexttimer(void)
+{
+	int i, next = -1;
+	
+	for (i = 0; i < F.timerp; i++)
+		if (next < 0 || F.timers[i].due < F.timers[next].due)
+			next = i;
+	return next;
+}
+
+
+// Waits up to timeout ms (-1 - until the next timer or event) and runs callbacks of ready descriptors and expired timers
+static int pollevents(int timeout)
+{
+	struct epoll_event events[64];
+	long long now;
+	int n = 0, handled = 0, i, next;
+	
+	next = nexttimer();
+	if (next >= 0) {
+		long long wait = (F.timers[next].due - fth_nanotime() + 999999) / 1000000;
+		if (wait < 0)
+			wait = 0;
+		if (timeout < 0 || wait < timeout)
+			timeout = wait;
+	}
+#ifndef FORTH_NO_BUDGET
+	CHECKDEADLINE();
+	if (F.deadline) {
+		long long wait = (F.deadline - fth_nanotime() + 999999) / 1000000;
+		if (timeout < 0 || wait < timeout)
+			timeout = wait;
+	}
+#endif
+	
+	if (F.nwatches > 0) {
+		n = epoll_wait(F.epollfd, events, 64, timeout);
+		check(n < 0 && errno != EINTR, "epoll error: %s", strerror(errno));
+	} else if (timeout > 0) {
+		struct timespec ts = {timeout / 1000, timeout % 1000 * 1000000};
+		nanosleep(&ts, NULL);
+	}
+	
+	// callbacks may change watches, so they are looked up again for every event
+	for (i = 0; i < n; i++) {
+		int fd = events[i].data.fd;
+		
+		if ((events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) && F.watches[fd].readxt) {
+			push(fd);
+			execute(F.watches[fd].readxt);
+			handled++;
+		}
+		if ((events[i].events & (EPOLLOUT | EPOLLHUP | EPOLLERR)) && F.watches[fd].writext) {
+			push(fd);
+			execute(F.watches[fd].writext);
+			handled++;
+		}
+	}
+	
+	now = fth_nanotime();
+	while ((next = nexttimer()) >= 0 && F.timers[next].due <= now) {
+		reactor_timer_t t = F.timers[next];
+		
+		if (t.period)
+			F.timers[next].due += t.period * 1000000LL;
+		else
+			F.timers[next] = F.timers[--F.timerp];
+		push(t.id);
+		execute(t.xt);
+		handled++;
+	}
+	return handled;
+}
+#endif
+
+
+#ifdef FORTH_THREADS
+// Runs iterations [lo + id * chunk, lo + (id + 1) * chunk) of the current loop on a copy of the caller's state
+static void runpart(int id)
+{
+	long long from = pool.lo + (long long)id * pool.chunk, to = from + pool.chunk, i;
+	int acc = pool.reduce == PAR_MIN ? INT_MAX : pool.reduce == PAR_MAX ? INT_MIN : 0, x, base;
+	
+	if (to > pool.hi)
+		to = pool.hi;
+	memcpy(&F, pool.master, sizeof(forth_t));
+	F.worker = id + 1;
+#ifndef FORTH_NO_CHECKPOINTS
+	F.dirtymap = NULL;		// the caller has marked all blocks
+#endif
+	F.sp = F.rsp = F.cfsp = 0;
+	if (!pool.loopframe)
+		F.lsp = 0;		// PAR-DO keeps the caller's loops for J
+	base = F.lsp;
+	F.running = 0;
+	F.errhandlers = 1;
+#ifndef FORTH_NO_PROFILER
+	F.profiling = 0;
+#endif
+#ifndef FORTH_NO_TRACER
+	F.tracemask = 0;
+#endif
+#ifndef FORTH_NO_TASKS
+	F.tasks = NULL;
+	F.taskp = F.task = 0;
+#endif
+#ifndef FORTH_NO_RESUMABLE
+	F.resumables = NULL;
+	F.resumablep = F.resuming = F.stepyield = 0;
+#endif
+#ifndef FORTH_NO_OUTPUT
+	F.outp = 0;
+#endif
+#ifndef FORTH_NO_BUDGET
+	F.fuel = 0;			// the first step takes a chunk of the shared budget
+#endif
+	
+	pool.parts[id].failed = 0;
+	if (setjmp(F.errjmp) == 0) {
+		for (i = from; i < to; i++) {
+			if (pool.loopframe) {
+				F.lsp = base;
+				lpush(i, pool.hi, 0);		// no LEAVE address
+			} else {
+				push(i);
+			}
+			execute(pool.xt);
+			if (pool.reduce) {
+				x = pop();
+				if (pool.reduce == PAR_SUM)
+					acc += x;
+				else if (pool.reduce == PAR_MIN ? x < acc : x > acc)
+					acc = x;
+			}
+		}
+		pool.parts[id].result = acc;
+	} else {
+		pool.parts[id].failed = 1;
+		strcpy(pool.parts[id].errormsg, F.errormsg);
+	}
+#ifndef FORTH_NO_BUDGET
+	if (F.budget >= 0 && F.fuel > 0)
+		__atomic_add_fetch(&pool.budget, F.fuel, __ATOMIC_RELAXED);
+#endif
+#ifndef FORTH_NO_OUTPUT
+	flushout(1);
+#endif
+}
+
+
+static void *worker(void *arg)
+{
+	int id = (int)(long)arg;
+	unsigned generation = 0;
+	
+	pthread_mutex_lock(&pool.lock);
+	for (;;) {
+		while (pool.generation == generation)
+			pthread_cond_wait(&pool.start, &pool.lock);
+		generation = pool.generation;
+		if (id < pool.active) {
+			pthread_mutex_unlock(&pool.lock);
+			runpart(id);
+			pthread_mutex_lock(&pool.lock);
+			if (--pool.pending == 0)
+				pthread_cond_signal(&pool.done);
+		}
+	}
+	return NULL;
+}
+
+
+// Splits [lo, hi) into contiguous parts executed by worker threads and combines their results
+static int parallel(int xt, int lo, int hi, int reduce, int loopframe)
+{
+	int n, i, result = reduce == PAR_MIN ? INT_MAX : reduce == PAR_MAX ? INT_MIN : 0;
+	
+	check(F.worker, "nested parallel loops are not supported");
+	checkcode(xt);
+#ifndef FORTH_NO_CHECKPOINTS
+	if (F.dirtymap)
+		dirty(0, F.ckdp);
+#endif
+	if (hi <= lo)
+		return result;
+	
+	pthread_mutex_lock(&pool.job);
+	n = pool.nworkers ? pool.nworkers : (int)sysconf(_SC_NPROCESSORS_ONLN);
+	if (n < 1)
+		n = 1;
+	if (n > WORKERS_MAX)
+		n = WORKERS_MAX;
+	if (n > (long long)hi - lo)
+		n = hi - lo;
+	while (pool.nthreads < n) {
+		pthread_t thread;
+		
+		if (pthread_create(&thread, NULL, worker, (void *)(long)pool.nthreads) != 0)
+			break;
+		pthread_detach(thread);
+		pool.nthreads++;
+	}
+	if (n > pool.nthreads)
+		n = pool.nthreads;
+	if (n == 0) {
+		pthread_mutex_unlock(&pool.job);
+		error("unable to start worker threads");
+	}
+#ifndef FORTH_NO_OUTPUT
+	fth_flush();		// keep the caller's output before the workers' one
+	// scratch areas of the workers for #> above HERE, the workers can't expand the data area
+	if (!reserve((void **)&F.data, &F.datacap, F.dp, n * (HOLD_SIZE + 1))) {
+		pthread_mutex_unlock(&pool.job);
+		error("unable to expand data area for parallel loop");
+	}
+#endif
+	
+	pthread_mutex_lock(&pool.lock);
+	pool.master = &F;
+	pool.xt = xt;
+	pool.lo = lo;
+	pool.hi = hi;
+	pool.chunk = ((long long)hi - lo + n - 1) / n;
+	pool.reduce = reduce;
+	pool.loopframe = loopframe;
+#ifndef FORTH_NO_BUDGET
+	pool.budget = fth_getfuel();
+#endif
+	pool.active = pool.pending = n;
+	pool.generation++;
+	pthread_cond_broadcast(&pool.start);
+	while (pool.pending)
+		pthread_cond_wait(&pool.done, &pool.lock);
+	pthread_mutex_unlock(&pool.lock);
+#ifndef FORTH_NO_BUDGET
+	if (F.budget >= 0) {		// the steps of the workers are charged to the caller
+		F.budget = pool.budget;
+		F.fuel = 0;
+	}
+#endif
+	
+	for (i = 0; i < n; i++) {
+		int x = pool.parts[i].result;
+		
+		if (pool.parts[i].failed) {
+			char msg[ERROR_MAX];
+			
+			strcpy(msg, pool.parts[i].errormsg);
+			pthread_mutex_unlock(&pool.job);
+			error("%s", msg);
+		}
+		if (reduce == PAR_SUM)
+			result += x;
+		else if (reduce == PAR_MIN ? x < result : reduce == PAR_MAX && x > result)
+			result = x;
+	}
+	pthread_mutex_unlock(&pool.job);
+	return result;
+}
+#endif
+
+
+static void core_prims(int prim, int pfa)
+{
+	switch (prim) {
+		// control flow
+		case LIT:
+		case LITXT:
+			push(F.code[F.ip++]);
+			break;
+		case ENTER:
+			STEP();
+			rpush();
+			F.running = pfa - 1;
+			F.ip = pfa;
+			PROFILE(profileenter());
+			TRACE(FORTH_TRACE_WORDS, TE_ENTER, F.running, 0);
+			break;
+		case EXIT:
+			while (F.lsp > 0 && F.lstack[F.lsp - 1].xt == F.running)
+				lpop();
+			PROFILE(profileexit());
+			TRACE(FORTH_TRACE_WORDS, TE_EXIT, F.running, 0);
+			rpop();
+			break;
+		case BRANCH:
+			STEP();
+			F.ip = F.code[F.ip];
+			break;
+		case QBRANCH:
+			STEP();
+			if (pop())
+				F.ip++;
+			else
+				F.ip = F.code[F.ip];
+			break;
+		case DODO: {
+			int index = pop(), limit = pop(), leave = F.code[F.ip++];
+			lpush(index, limit, leave);
+			break;
+		}
+		case DOQDO: {
+			int index = pop(), limit = pop(), leave = F.code[F.ip++];
+			if (index != limit)
+				lpush(index, limit, leave);
+			else
+				F.ip = leave;
+			break;
+		}
+		case DOLOOP:
+			STEP();
+			check(F.lsp <= 0, "usage of LOOP outside any loop");
+			if (++F.lstack[F.lsp - 1].index == F.lstack[F.lsp - 1].limit) {
+				F.ip++;
+				lpop();
+			} else {
+				F.ip = F.code[F.ip];
+			}
+			break;
+		case DOADDLOOP: {
+			int step, index, limit;
+			STEP();
+			step = pop();
+			check(F.lsp <= 0, "usage of +LOOP outside any loop");
+			index = F.lstack[F.lsp - 1].index;
+			limit = F.lstack[F.lsp - 1].limit;
+			if ((index < limit) == (index + step < limit)) {
+				F.lstack[F.lsp - 1].index += step;
+				F.ip = F.code[F.ip];
+			} else {
+				F.ip++;
+				lpop();
+			}
+			break;
+		}
+		case DO:
+			compile(F.dodo_xt);
+			markfwd(CFDO);
+			markback(CFLOOP);
+			break;
+		case QDO:
+			compile(F.doqdo_xt);
+			markfwd(CFDO);
+			markback(CFLOOP);
+			break;
+		case LOOP:
+			compile(F.doloop_xt);
+			resolveback(CFLOOP);
+			resolvefwd(CFDO);
+			break;
+		case ADDLOOP:
+			compile(F.doaddloop_xt);
+			resolveback(CFLOOP);
+			resolvefwd(CFDO);
+			break;
+		case IF:
+			compile(F.qbranch_xt);
+			markfwd(CFIF);
+			break;
+		case ELSE: {
+			int ifbranch;
+			check(cfpeek() != CFIF, "unbalanced control structure");
+			ifbranch = cfpop(CFIF);
+			compile(F.branch_xt);
+			markfwd(CFELSE);
+			cfpush(CFIF, ifbranch);
+			resolvefwd(CFIF);
+			break;
+		}
+		case THEN: {
+			enum cftype type = cfpeek();
+			check(type != CFIF && type != CFELSE, "unbalanced control structure");
+			resolvefwd(type);
+			break;
+		}
+		case BEGIN:
+			markback(CFBEGIN);
+			break;
+		case UNTIL:
+			compile(F.qbranch_xt);
+			resolveback(CFBEGIN);
+			break;
+		case AGAIN:
+			compile(F.branch_xt);
+			resolveback(CFBEGIN);
+			break;
+		case WHILE: {
+			int beginbranch = cfpop(CFBEGIN);
+			compile(F.qbranch_xt);
+			markfwd(CFWHILE);
+			cfpush(CFBEGIN, beginbranch);
+			break;
+		}
+		case REPEAT:
+			compile(F.branch_xt);
+			resolveback(CFBEGIN);
+			resolvefwd(CFWHILE);
+			break;
+		case LEAVE:
+			check(F.lsp <= 0, "attempt to use LEAVE outside any loop");
+#ifdef FORTH_THREADS
+			check(F.lstack[F.lsp - 1].leave == 0, "LEAVE can't be used in parallel loop");
+#endif
+			check(F.lstack[F.lsp - 1].xt != F.running, "LEAVE called from nested definition");
+			F.ip = F.lstack[F.lsp - 1].leave;
+			lpop();
+			break;
+		case I:
+			check(F.lsp <= 0, "attempt to use I outside any loop");
+			push(F.lstack[F.lsp - 1].index);
+			break;
+		case J:
+			check(F.lsp <= 1, "attempt to use J without outer loop");
+			push(F.lstack[F.lsp - 2].index);
+			break;
+		case COLON:
+			check(getword(' ') == 0, "word required for :");
+			create(F.word, SMUDGED, ENTER);
+			F.state = FORTH_BOOL(1);
+			break;
+		case SEMICOLON:
+			check(F.state == 0, "; is used outside any definition");
+			check(F.cfsp > 0, "unbalanced control structure");
+			compile(F.exit_xt);
+			patchflags(F.code[F.current]);
+			CLR(F.dict[F.code[F.current]].flags, SMUDGED);
+			F.state = 0;
+			break;
+		case EXECUTE: {
+			int xt = pop();
+			checkcode(xt);
+			execute(xt);
+			break;
+		}
+		case DOTRY: {
+			jmp_buf ojmp;
+			int osp = F.sp, orsp = F.rsp, olsp = F.lsp, oip = F.ip, orunning = F.running;
+			const char *osource = F.source;
+			int ointp = F.intp, ostate = F.state;
+			memcpy(ojmp, F.errjmp, sizeof(jmp_buf));
+			F.errhandlers++;
+			if (setjmp(F.errjmp) == 0) {
+				int xt = F.code[F.ip++];
+				checkcode(xt);
+				execute(xt);
+				memcpy(F.errjmp, ojmp, sizeof(jmp_buf));
+				F.errhandlers--;
+				push(~0);
+			} else {
+				TRACE(FORTH_TRACE_ERRORS, TE_CATCH, F.running, 0);
+				TRACEUNWIND(orsp);
+				F.sp = osp, F.rsp = orsp, F.lsp = olsp, F.ip = oip, F.running = orunning;
+				if (F.running)
+					F.ip++;
+				F.source = osource;
+				F.intp = ointp, F.state = ostate;
+				memcpy(F.errjmp, ojmp, sizeof(jmp_buf));
+				F.errhandlers--;
+				F.stats.caught++;
+				push(0);
+			}
+			break;
+		}
+		case TRY: {
+			word_t *w;
+			check(getword(' ') == 0, "word required for TRY");
+			w = find(F.word);
+			check(!w, "%s ?", F.word);
+			
+			if (F.state) {
+				compile(F.dotry_xt);
+				compile(w->xt);
+			} else {
+				jmp_buf ojmp;
+				int osp = F.sp, orsp = F.rsp, olsp = F.lsp, oip = F.ip, orunning = F.running;
+				const char *osource = F.source;
+				int ointp = F.intp, ostate = F.state;
+				memcpy(ojmp, F.errjmp, sizeof(jmp_buf));
+				F.errhandlers++;
+				if (setjmp(F.errjmp) == 0) {
+					checkcode(w->xt);
+					execute(w->xt);
+					memcpy(F.errjmp, ojmp, sizeof(jmp_buf));
+					F.errhandlers--;
+					push(~0);
+				} else {
+					TRACE(FORTH_TRACE_ERRORS, TE_CATCH, F.running, 0);
+					TRACEUNWIND(orsp);
+					F.sp = osp, F.rsp = orsp, F.lsp = olsp, F.ip = oip, F.running = orunning;
+					if (F.running)
+						F.ip++;
+					F.source = osource;
+					F.intp = ointp, F.state = ostate;
+					memcpy(F.errjmp, ojmp, sizeof(jmp_buf));
+					F.errhandlers--;
+					F.stats.caught++;
+					push(0);
+				}
+			}
+			break;
+		}
+		case ERROR: {
+			int a = pop(), length = fth_length(a);
+			error("%.*s", length, dataarea(a, length, 0));
+			break;
+		}
+			
+		// arithmetic
+		case ADD: {
+			int b = pop(), a = pop();
+			push(a + b);
+			break;
+		}
+		case SUB: {
+			int b = pop(), a = pop();
+			push(a - b);
+			break;
+		}
+		case MUL: {
+			int b = pop(), a = pop();
+			push(a * b);
+			break;
+		}
+		case DIV: {
+			int b = pop(), a = pop();
+			check(b == 0, "division by zero");
+			push(a / b);
+			break;
+		}
+		case MOD: {
+			int b = pop(), a = pop();
+			check(b == 0, "division by zero");
+			push(a % b);
+			break;
+		}
+		case DIVMOD: {
+			int b = pop(), a = pop();
+			check(b == 0, "division by zero");
+			push(a % b);
+			push(a / b);
+			break;
+		}
+		case NEGATE:
+			push(-pop());
+			break;
+		case ONEADD:
+			push(pop() + 1);
+			break;
+		case ONESUB:
+			push(pop() - 1);
+			break;
+		case CELL:
+			push(sizeof(int));
+			break;
+		case CELLS:
+			push(pop() * sizeof(int));
+			break;
+		case CELLADD:
+			push(pop() + sizeof(int));
+			break;
+		case CELLSUB:
+			push(pop() - sizeof(int));
+			break;
+		case MIN: {
+			int b = pop(), a = pop();
+			push(a < b ? a : b);
+			break;
+		}
+		case MAX: {
+			int b = pop(), a = pop();
+			push(a > b ? a : b);
+			break;
+		}
+		case ABS: {
+			int a = pop();
+			push(a < 0 ? -a : a);
+			break;
+		}
+		
+		// stack
+		case SWAP: {
+			int b = pop(), a = pop();
+			push(b);
+			push(a);
+			break;
+		}
+		case DUP: {
+			int a = pop();
+			push(a);
+			push(a);
+			break;
+		}
+		case DROP:
+			(void)pop();
+			break;
+		case ROT: {
+			int c = pop(), b = pop(), a = pop();
+			push(b);
+			push(c);
+			push(a);
+			break;
+		}
+		case MROT: {
+			int c = pop(), b = pop(), a = pop();
+			push(c);
+			push(a);
+			push(b);
+			break;
+		}
+		case TUCK: {
+			int b = pop(), a = pop();
+			push(b);
+			push(a);
+			push(b);
+			break;
+		}
+		case OVER: {
+			int b = pop(), a = pop();
+			push(a);
+			push(b);
+			push(a);
+			break;
+		}
+		case NIP: {
+			int b = pop();
+			(void)pop();
+			push(b);
+			break;
+		}
+		case DDUP: {
+			int b = pop(), a = pop();
+			push(a);
+			push(b);
+			push(a);
+			push(b);
+			break;
+		}
+		case DDROP:
+			(void)pop();
+			(void)pop();
+			break;
+		case QDUP: {
+			int a = pop();
+			if (a)
+				push(a);
+			push(a);
+			break;
+		}
+		
+		// logic
+		case AND: {
+			int b = pop(), a = pop();
+			push(a & b);
+			break;
+		}
+		case OR: {
+			int b = pop(), a = pop();
+			push(a | b);
+			break;
+		}
+		case NOT:
+			push(~pop());
+			break;
+		case XOR: {
+			int b = pop(), a = pop();
+			push(a ^ b);
+			} break;
+		case LESS: {
+			int b = pop(), a = pop();
+			push(FORTH_BOOL(a < b));
+			break;
+		}
+		case LESSEQUAL: {
+			int b = pop(), a = pop();
+			push(FORTH_BOOL(a <= b));
+			break;
+		}
+		case GREATER: {
+			int b = pop(), a = pop();
+			push(FORTH_BOOL(a > b));
+			break;
+		}
+		case GREATEREQUAL: {
+			int b = pop(), a = pop();
+			push(FORTH_BOOL(a >= b));
+			break;
+		}
+		case EQUAL: {
+			int b = pop(), a = pop();
+			push(FORTH_BOOL(a == b));
+			break;
+		}
+		case NOTEQUAL: {
+			int b = pop(), a = pop();
+			push(FORTH_BOOL(a != b));
+			break;
+		}
+		case ZEROLESS:
+			push(FORTH_BOOL(pop() < 0));
+			break;
+		case ZEROGREATER:
+			push(FORTH_BOOL(pop() > 0));
+			break;
+		case ZEROEQUAL:
+			push(FORTH_BOOL(pop() == 0));
+			break;
+		case ZERONOTEQUAL:
+			push(FORTH_BOOL(pop()));
+			break;
+		case FALSE:
+			push(0);
+			break;
+		case TRUE:
+			push(~0);
+			break;
+		case WITHIN: {
+			int b = pop(), a = pop(), x = pop();
+			push(FORTH_BOOL(a <= x && x < b));
+			break;
+		}
+		case BETWEEN: {
+			int b = pop(), a = pop(), x = pop();
+			push(FORTH_BOOL(a <= x && x <= b));
+			break;
+		}
+		
+		// data
+		case DOCONSTANT:
+			push(F.code[pfa]);
+			break;
+		case DOVARIABLE:
+			push(F.code[pfa]);		// is variable a constant !?!!
+			break;
+		case CONSTANT:
+			check(getword(' ') == 0, "word required for CONSTANT");
+			create(F.word, 0, DOCONSTANT);
+			compile(pop());
+			break;
+		case VARIABLE:
+			check(getword(' ') == 0, "word required for VARIABLE");
+			create(F.word, 0, DOVARIABLE);
+			compile(F.dp);
+			compile(0);			// xt of DOES>-part
+			dcompile(0);
+			break;
+		case DODOES:
+			STEP();
+			push(F.code[pfa]);
+			rpush();
+			F.running = pfa - 1;
+			F.ip = F.code[pfa + 1];
+			PROFILE(profileenter());
+			TRACE(FORTH_TRACE_WORDS, TE_ENTER, F.running, 0);
+			break;
+		case FETCH:
+			push(fetch(pop()));
+			break;
+		case STORE: {
+			int a = pop(), x = pop();
+			store(a, x);
+			break;
+		}
+		case CFETCH:
+			push(cfetch(pop()) & 0xFF);
+			break;
+		case CSTORE: {
+			int a = pop(), x = pop();
+			cstore(a, x);
+			break;
+		}
+		case COMMA:
+			dcompile(pop());
+			break;
+		case CCOMMA:
+			ccompile(pop());
+			break;
+		case CREATE:
+			check(getword(' ') == 0, "word required for CREATE");
+			create(F.word, 0, DOVARIABLE);
+			compile(F.dp);
+			compile(0);			// xt of DOES>-part
+			break;
+		case DOES:
+			check(F.code[F.dict[F.code[F.current]].xt] != DOVARIABLE, "%s is not CREATEd", &F.names[F.dict[F.code[F.current]].name]);
+			patchcode(F.dict[F.code[F.current]].xt);
+			patchcode(F.dict[F.code[F.current]].xt + 2);
+			F.code[F.dict[F.code[F.current]].xt] = DODOES;
+			if (F.running) {
+				F.code[F.dict[F.code[F.current]].xt + 2] = F.ip;
+				PROFILE(profileexit());
+				TRACE(FORTH_TRACE_WORDS, TE_EXIT, F.running, 0);
+				rpop();
+			} else {
+				F.code[F.dict[F.code[F.current]].xt + 2] = F.cp;
+				F.state = FORTH_BOOL(1);
+			}
+			break;
+		case ADDSTORE: {
+			int a = pop();
+			store(a, fetch(a) + pop());
+			break;
+		}
+		case DOVALUE:
+			push(fetch(F.code[pfa]));
+			break;
+		case VALUE:
+			check(getword(' ') == 0, "word required for VALUE");
+			create(F.word, 0, DOVALUE);
+			compile(F.dp);
+			dcompile(0);
+			break;
+		case TO: {
+			word_t *w;
+			check(getword(' ') == 0, "word required for TO");
+			w = find(F.word);
+			check(w == NULL, "%s ?", F.word);
+			check(F.code[w->xt] != DOVALUE, "%s is not a VALUE", F.word);
+			if (F.state) {
+				compile(F.lit_xt);
+				compile(F.code[w->xt + 1]);
+				compile(F.store_xt);
+			} else {
+				store(F.code[w->xt + 1], pop());
+			}
+			break;
+		}
+		case HERE:
+			push(F.dp);
+			break;
+		case ALLOT: {
+			int size = pop();
+			checkworker();
+			check(!reserve((void **)&F.data, &F.datacap, F.dp, size), "unable to expand data area while ALLOTing %d bytes", size);
+#ifndef FORTH_NO_CHECKPOINTS
+			if (size < 0 && F.dirtymap)		// freed space will be written again
+				dirty(F.dp + size, -size);
+#endif
+			F.dp += size;
+			PEAK(F.stats.dppeak, F.dp);
+			break;
+		}
+		case ALIGN: {
+			int size = -F.dp & (sizeof(int) - 1);
+			checkworker();
+			check(!reserve((void **)&F.data, &F.datacap, F.dp, size), "unable to expand data area while aligning");
+			memset(&F.data[F.dp], 0, size);
+			F.dp += size;
+			PEAK(F.stats.dppeak, F.dp);
+			break;
+		}
+		case ALIGNED:
+			push((pop() + sizeof(int) - 1) & ~(sizeof(int) - 1));
+			break;
+		case TODATA: {
+			int xt = pop();
+			checkcode(xt);
+			check(F.code[xt] != DOVARIABLE && F.code[xt] != DODOES, "attempt to get data address of something, that is not CREATEd");
+			push(F.code[xt + 1]);
+			break;
+		}
+		case MOVE: {
+			int size = pop(), b = pop(), a = pop();
+			memmove(dataarea(b, size, 1), dataarea(a, size, 0), size);
+			break;
+		}
+		case FILL: {
+			int c = pop(), size = pop(), a = pop();
+			memset(dataarea(a, size, 1), c, size);
+			break;
+		}
+		case ERASE: {
+			int size = pop(), a = pop();
+			memset(dataarea(a, size, 1), 0, size);
+			break;
+		}
+		
+		// compilation
+		case CODECOMMA:
+			compile(pop());
+			break;
+		case COMPILE: {
+			word_t *w;
+			check(getword(' ') == 0, "word required for COMPILE");
+			w = find(F.word);
+			check(w == NULL, "%s ?", F.word);
+			compile(F.litxt_xt);
+			compile(w->xt);
+			compile(F.codecomma_xt);
+			break;
+		}
+		case COMPILENOW: {
+			word_t *w;
+			check(getword(' ') == 0, "word required for [COMPILE]");
+			w = find(F.word);
+			check(w == NULL, "%s ?", F.word);
+			compile(w->xt);
+			break;
+		}
+		case TICK: {
+			word_t *w;
+			check(getword(' ') == 0, "word required for '");
+			w = find(F.word);
+			check(w == NULL, "%s ?", F.word);
+			push(w->xt);
+			break;
+		}
+		case TICKNOW: {
+			word_t *w;
+			check(getword(' ') == 0, "word required for [']");
+			w = find(F.word);
+			check(w == NULL, "%s ?", F.word);
+			compile(F.litxt_xt);
+			compile(w->xt);
+			break;
+		}
+		case MAKEIMMEDIATE:
+			patchflags(F.code[F.current]);
+			SET(F.dict[F.code[F.current]].flags, IMMEDIATE);
+			break;
+		case STATE:
+			push(FORTH_BOOL(F.state));
+			break;
+		case COMPON:
+			F.state = ~0;
+			break;
+		case COMPOFF:
+			F.state = 0;
+			break;
+		case BLOCKSTART:
+			F.state = ~0;
+			indexcode(F.cp, 0);
+			push(F.cp);
+			compile(ENTER);
+			break;
+		case BLOCKEND:
+			check(F.state == 0, "attempt to use } outside any definition");
+			check(F.cfsp > 0, "unbalanced control structure");
+			F.state = 0;
+			compile(F.exit_xt);
+			execute(pop());
+			break;
+		case LENCODE:
+			push(F.cp);
+			break;
+		case LENDICT:
+			push(F.dictp);
+			break;
+		case LENNAMES:
+			push(F.namesp);
+			break;
+		
+		// parsing, strings and tools
+		case BLOCKCOMMENT:
+			check(parse(')', NULL, NULL) == 0, "unmatched (");
+			break;
+		case LINECOMMENT:
+			parse('\n', NULL, NULL);
+			break;
+		case CHAR:
+			check(getword(' ') == 0, "word required for CHAR");
+			if (F.state) {
+				compile(F.lit_xt);
+				compile(F.word[0]);
+			} else {
+				push(F.word[0]);
+			}
+			break;
+		case QUOTE: {
+			int start, length;
+			check(parse('"', &start, &length) == 0, "unmatched \"");
+			if (F.state) {
+				compile(F.lit_xt);
+				compile(F.dp);
+			} else {
+				push(F.dp);
+			}
+			scompile(&F.source[start], length);
+			break;
+		}
+		case DEPTH:
+			push(F.sp);
+			break;
+		case LENGTH:
+			push(fth_length(pop()));
+			break;
+		case COUNT: {
+			int a = pop(), length = fth_length(a);
+			push(a);
+			push(length);
+			break;
+		}
+		case BL:
+			push(' ');
+			break;
+		case STRING: {
+			int sep = pop(), start, length;
+			check(!parse(sep, &start, &length), "string separated by `%c' required for STRING", sep);
+			push(F.dp);
+			scompile(&F.source[start], length);
+			break;
+		}
+		case WORD:
+			check(getword(pop()) == 0, "word required for WORD");
+			check(!reserve((void **)&F.data, &F.datacap, F.dp, strlen(F.word) + 1), "unable to expand data area while placing word %s", F.word);
+			strcpy(&F.data[F.dp], F.word);
+			push(F.dp);
+			break;
+		case VOCABULARY:
+			check(getword(' ') == 0, "word required for VOCABULARY");
+			create(F.word, 0, DOVOCABULARY);
+			compile(0);			// dict address of latest definition in this voc
+			compile(F.current);		// link to parent voc
+			break;
+		case DOVOCABULARY:
+			F.context = pfa;
+			break;
+		case DEFINITIONS:
+			F.current = F.context;
+			break;
+#ifndef FORTH_NO_SAVES
+		case SAVE: {
+			int a = pop();
+			checkdata(a, 1);
+			fth_savesystem(&F.data[a]);
+			break;
+		}
+		case LOAD: {
+			int a = pop();
+			checkdata(a, 1);
+			fth_loadsystem(&F.data[a]);
+			break;
+		}
+		case SAVEPROGRAM: {
+			int entry = pop();
+			int a = pop();
+			checkcode(entry);
+			checkdata(a, 1);
+			saveprogram(&F.data[a], entry);
+			break;
+		}
+		case SHAKEPROGRAM: {
+			int entry = pop();
+			int a = pop();
+			checkcode(entry);
+			checkdata(a, 1);
+			push(shakeprogram(&F.data[a], entry));
+			break;
+		}
+		case SAVEDATA: {
+			int a = pop();
+			checkdata(a, 1);
+			fth_savedata(&F.data[a]);
+			break;
+		}
+		case LOADDATA: {
+			int a = pop();
+			checkdata(a, 1);
+			fth_loaddata(&F.data[a]);
+			break;
+		}
+#endif
+#ifndef FORTH_NO_PROFILER
+		case PROFILEON:
+			fth_setprofiling(1);
+			break;
+		case PROFILEOFF:
+			fth_setprofiling(0);
+			break;
+		case PROFILERESET:
+			fth_resetprofile();
+			break;
+#endif
+#ifdef FORTH_OPSTATS
+		case DUMPOPSTATS: {
+			int a = pop();
+			checkdata(a, 1);
+			fth_dumpopstats(&F.data[a]);
+			break;
+		}
+		case RESETOPSTATS:
+			fth_resetopstats();
+			break;
+#endif
+#ifndef FORTH_NO_TRACER
+		case TRACEON:
+			check(!fth_starttrace(pop(), 0), "unable to allocate trace buffer");
+			break;
+		case TRACEOFF:
+			fth_stoptrace();
+			break;
+		case SAVETRACE: {
+			int a = pop();
+			checkdata(a, 1);
+			fth_savetrace(&F.data[a], 1, 1);
+			break;
+		}
+#endif
+#ifndef FORTH_NO_OUTPUT
+		case TYPE: {
+			int length = pop(), a = pop();
+			check(length < 0, "invalid string length %d", length);
+			fth_type(dataarea(a, length, 0), length);
+			break;
+		}
+		case FLUSH:
+			fth_flush();
+			break;
+		case LESSNUMBER:
+			F.holdp = HOLD_SIZE;
+			break;
+		case NUMBER: {
+			unsigned u = pop();
+			hold('0' + u % 10);
+			push(u / 10);
+			break;
+		}
+		case NUMBERS: {
+			unsigned u = pop();
+			do {
+				hold('0' + u % 10);
+				u /= 10;
+			} while (u);
+			push(0);
+			break;
+		}
+		case HOLD:
+			hold(pop());
+			break;
+		case SIGN:
+			if (pop() < 0)
+				hold('-');
+			break;
+		case NUMBERGREATER: {
+			int length = HOLD_SIZE - F.holdp, a = F.dp;
+			pop();
+#ifdef FORTH_THREADS
+			if (F.worker)		// every worker has its own area reserved by parallel()
+				a += (F.worker - 1) * (HOLD_SIZE + 1);
+			else
+#endif
+			check(!reserve((void **)&F.data, &F.datacap, F.dp, length + 1), "unable to expand data area for pictured numeric output");
+			memcpy(&F.data[a], &F.hold[F.holdp], length);
+			F.data[a + length] = '\0';
+			push(a);
+			push(length);
+			break;
+		}
+#endif
+#ifndef FORTH_NO_ATOMICS
+		case ATOMICFETCH:
+			push(__atomic_load_n(atomiccell(pop(), 0), __ATOMIC_SEQ_CST));
+			break;
+		case ATOMICSTORE: {
+			int a = pop(), x = pop();
+			__atomic_store_n(atomiccell(a, 1), x, __ATOMIC_SEQ_CST);
+			break;
+		}
+		case ATOMICADDSTORE: {
+			int a = pop(), x = pop();
+			push(__atomic_fetch_add(atomiccell(a, 1), x, __ATOMIC_SEQ_CST));
+			break;
+		}
+		case CAS: {
+			int a = pop(), new = pop(), old = pop();
+			push(FORTH_BOOL(__atomic_compare_exchange_n(atomiccell(a, 1), &old, new, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)));
+			break;
+		}
+		case FENCE:
+			__atomic_thread_fence(__ATOMIC_SEQ_CST);
+			break;
+#endif
+#ifndef FORTH_NO_CHANNELS
+		case CHANNEL:
+		case SPSCCHANNEL: {
+			int ch;
+			check(getword(' ') == 0, "word required for CHANNEL");
+			ch = fth_newchannel(pop(), prim == SPSCCHANNEL);
+			check(!ch, "unable to create channel %s", F.word);
+			create(F.word, 0, DOCONSTANT);
+			compile(ch);
+			break;
+		}
+		case SEND:
+		case SENDBUF: {
+			int ch = pop(), y = prim == SENDBUF ? pop() : 0, x = pop(), spins = 0, r;
+			if (prim == SENDBUF)
+				check(y < 0 || !dataarea(x, y, 0), "invalid data area %d (%d bytes)", x, y);
+			while ((r = fth_trysend(ch, x, y)) == 0) {
+				if (yieldable(pfa)) {
+					push(x);
+					if (prim == SENDBUF)
+						push(y);
+					push(ch);
+					yield();
+					break;
+				}
+				backoff(&spins);
+			}
+			check(r < 0, "channel %d is closed", ch);
+			break;
+		}
+		case RECV:
+		case RECVBUF: {
+			int ch = pop(), x, y, spins = 0, r;
+			while ((r = fth_tryrecv(ch, &x, &y)) == 0) {
+				if (yieldable(pfa)) {
+					push(ch);
+					yield();
+					break;
+				}
+				backoff(&spins);
+			}
+			check(r < 0, "channel %d is closed", ch);
+			if (r > 0) {
+				push(x);
+				if (prim == RECVBUF)
+					push(y);
+			}
+			break;
+		}
+		case TRYSEND: {
+			int ch = pop(), x = pop(), r = fth_trysend(ch, x, 0);
+			check(r < 0, "channel %d is closed", ch);
+			push(FORTH_BOOL(r));
+			break;
+		}
+		case TRYRECV: {
+			int ch = pop(), x, y, r = fth_tryrecv(ch, &x, &y);
+			check(r < 0, "channel %d is closed", ch);
+			if (r)
+				push(x);
+			push(FORTH_BOOL(r));
+			break;
+		}
+		case SENDN:
+		case RECVN: {
+			int ch = pop(), n = pop(), a = pop(), spins = 0, r = 1, x, y;
+			check(n < 0, "invalid number of cells %d", n);
+			dataarea(a, n * sizeof(int), prim == RECVN);
+			for (; n > 0; a += sizeof(int), n--) {
+				// cells may be unaligned, so they are read and written by fetch() and store()
+				while ((r = prim == SENDN ? fth_trysend(ch, fetch(a), 0) : fth_tryrecv(ch, &x, &y)) == 0) {
+					if (yieldable(pfa)) {
+						push(a);
+						push(n);
+						push(ch);
+						yield();
+						break;
+					}
+					backoff(&spins);
+				}
+				if (r <= 0)
+					break;
+				if (prim == RECVN)
+					store(a, x);
+			}
+			check(r < 0, "channel %d is closed", ch);
+			break;
+		}
+		case CLOSECHANNEL:
+			fth_closechannel(pop());
+			break;
+#endif
+#ifndef FORTH_NO_TASKS
+		case TASK:
+			check(getword(' ') == 0, "word required for TASK");
+			if (!F.tasks) {
+				F.tasks = (task_t *)malloc(2 * sizeof(task_t));
+				check(!F.tasks, "unable to allocate task %s", F.word);
+				F.taskscap = 2 * sizeof(task_t);
+				F.tasks[0].next = F.tasks[0].prev = 0;
+				F.taskp = 1;
+			}
+			check(!reserve((void **)&F.tasks, &F.taskscap, F.taskp * sizeof(task_t), sizeof(task_t)), "unable to allocate task %s", F.word);
+			F.tasks[F.taskp].next = F.tasks[F.taskp].prev = -1;
+			create(F.word, 0, DOCONSTANT);
+			compile(F.taskp++);
+			break;
+		case ACTIVATE: {
+			int task = pop();
+			task_t *t;
+			check(task <= 0 || task >= F.taskp, "invalid task %d", task);
+			check(task == F.task, "task can't ACTIVATE itself");
+			check(!F.running, "ACTIVATE used outside of definition");
+			check(F.lsp > 0 && F.lstack[F.lsp - 1].xt == F.running, "ACTIVATE used inside loop");
+			
+			// the task continues the definition after ACTIVATE, while the caller leaves it
+			t = &F.tasks[task];
+			t->sp = t->lsp = 0;
+			t->rstack[0].ip = t->rstack[0].xt = 0;
+			t->rsp = 1;
+			t->ip = F.ip;
+			t->running = F.running;
+			if (t->next < 0)
+				linktask(task);
+			PROFILE(profileexit());
+			TRACE(FORTH_TRACE_WORDS, TE_EXIT, F.running, 0);
+			rpop();
+			break;
+		}
+		case PAUSE:
+			fth_pause();
+			break;
+		case STOP:
+			check(!F.task, "main task can't be stopped");
+			stoptask();
+			break;
+#endif
+#ifndef FORTH_NO_BUDGET
+		case SETBUDGET: {
+			int ms = pop(), steps = pop();
+			long long left = fth_getfuel();
+			
+			check(steps < 0 || ms < 0, "invalid budget %d steps, %d ms", steps, ms);
+			// scripts may only tighten the limits set by the host
+			if (steps && (left < 0 || steps < left)) {
+				F.budget = steps;
+				F.fuel = 0;
+			}
+			if (ms && (!F.deadline || fth_nanotime() + ms * 1000000LL < F.deadline))
+				F.deadline = fth_nanotime() + ms * 1000000LL;
+			break;
+		}
+		case FUEL: {
+			long long left = fth_getfuel();
+			push(left > INT_MAX ? INT_MAX : (int)left);
+			break;
+		}
+#endif
+#ifndef FORTH_NO_RESUMABLE
+		case YIELD:
+			suspend();
+			break;
+#endif
+#ifdef FORTH_REACTOR
+		case OPENSOCKET: {
+			struct sockaddr_un addr;
+			int fd = unixsocket(pop(), &addr);
+			if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 && errno != EINPROGRESS) {
+				int err = errno;
+				close(fd);
+				error("connect error: %s", strerror(err));
+			}
+			push(fd);
+			break;
+		}
+		case LISTENSOCKET: {
+			struct sockaddr_un addr;
+			struct stat st;
+			int fd = unixsocket(pop(), &addr);
+			// only a socket left by a previous listener is replaced, other files make bind() fail
+			if (lstat(addr.sun_path, &st) == 0 && S_ISSOCK(st.st_mode))
+				unlink(addr.sun_path);
+			if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, SOMAXCONN) < 0) {
+				int err = errno;
+				close(fd);
+				error("listen error: %s", strerror(err));
+			}
+			push(fd);
+			break;
+		}
+		case ACCEPT:
+			push(nonblocking(accept4(pop(), NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC), "accept"));
+			break;
+		case SOCKETPAIR:
+		case PIPE: {
+			int fds[2];
+			if (prim == SOCKETPAIR) {
+				check(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds) < 0, "socketpair error: %s", strerror(errno));
+			} else {
+				check(pipe2(fds, O_NONBLOCK | O_CLOEXEC) < 0, "pipe error: %s", strerror(errno));
+			}
+			push(fds[0]);
+			push(fds[1]);
+			break;
+		}
+		case READ:
+		case WRITE: {
+			int fd = pop(), length = pop(), a = pop();
+			check(length < 0, "invalid length %d", length);
+			if (prim == READ)
+				push(nonblocking(read(fd, dataarea(a, length, 1), length), "read"));
+			else
+				push(nonblocking(write(fd, dataarea(a, length, 0), length), "write"));
+			break;
+		}
+		case CLOSE: {
+			int fd = pop();
+			unwatch(fd);
+			check(close(fd) < 0, "close error: %s", strerror(errno));
+			break;
+		}
+		case ONREADABLE:
+		case ONWRITABLE: {
+			int fd = pop(), xt = pop();
+			reactor_watch_t w = {0, 0};
+			if (F.watches && fd >= 0 && (fd + 1) * (int)sizeof(reactor_watch_t) <= F.watchescap)
+				w = F.watches[fd];
+			if (prim == ONREADABLE)
+				watch(fd, xt, w.writext);
+			else
+				watch(fd, w.readxt, xt);
+			break;
+		}
+		case AFTER:
+		case EVERY: {
+			int ms = pop(), xt = pop();
+			check(prim == EVERY && ms <= 0, "invalid timer period %d", ms);
+			push(addtimer(xt, ms, prim == EVERY ? ms : 0));
+			break;
+		}
+		case CANCEL:
+			canceltimer(pop());
+			break;
+		case POLLEVENTS:
+			push(pollevents(pop()));
+			break;
+		case RUNEVENTS:
+			F.stopevents = 0;
+			while (!F.stopevents && (F.nwatches > 0 || F.timerp > 0))
+				pollevents(-1);
+			break;
+		case STOPEVENTS:
+			fth_stopevents();
+			break;
+#endif
+#ifdef FORTH_THREADS
+		case PARDO:
+			check(!F.state, "PAR-DO used outside of definition");
+			compile(F.branch_xt);		// the body is compiled in place as a nameless definition
+			markfwd(CFPARDO);
+			markback(CFPARLOOP);
+			compile(ENTER);
+			break;
+		case PARLOOP: {
+			int body;
+			check(!F.state, "PAR-LOOP used outside of definition");
+			compile(F.exit_xt);
+			body = cfpop(CFPARLOOP);
+			resolvefwd(CFPARDO);
+			compile(F.litxt_xt);
+			compile(body);
+			compile(F.parloop_xt);
+			break;
+		}
+		case DOPARLOOP: {
+			int xt = pop(), lo = pop(), hi = pop();
+			parallel(xt, lo, hi, PAR_NONE, 1);
+			break;
+		}
+		case PARFOR:
+		case PARSUM:
+		case PARMIN:
+		case PARMAX: {
+			int hi = pop(), lo = pop(), xt = pop();
+			int result = parallel(xt, lo, hi, prim - PARFOR, 0);
+			if (prim != PARFOR)
+				push(result);
+			break;
+		}
+		case SETWORKERS:
+			fth_setworkers(pop());
+			break;
+#endif
+#ifdef FORTH_SAMPLER
+		case SAMPLEON:
+			check(!fth_startsampling(pop(), 0), "unable to start sampling: %s", strerror(errno));
+			break;
+		case SAMPLEOFF:
+			fth_stopsampling();
+			break;
+		case SAVESAMPLES: {
+			int a = pop();
+			checkdata(a, 1);
+			fth_savesamples(&F.data[a]);
+			break;
+		}
+#endif
+		
+		default:
+			TRACE(FORTH_TRACE_PRIMS, TE_PRIM, prim, 0);
+			if (F.app_funcs && (unsigned)prim < CORE_PRIM_FIRST && F.app_funcs[prim].func) {
+				F.app_funcs[prim].func(F.app_funcs[prim].udata);
+			} else {
+				check(!F.app_prims, "invalid opcode: %d", prim);
+				F.app_prims(prim);
+			}
+			TRACE(FORTH_TRACE_PRIMS, TE_PRIMEND, prim, 0);
+			break;
+	}
+}
+
+
+// ================================== API =====================================
+
+// ... for application primitives
+void fth_error(const char *fmt, ...)
+{
+	va_list args;
+	
+	if (fmt != F.errormsg) {		// for re-throwing error messages
+		va_start(args, fmt);
+		vsnprintf(F.errormsg, ERROR_MAX, fmt, args);
+		va_end(args);
+		F.stats.errors++;
+		TRACE(FORTH_TRACE_ERRORS, TE_ERROR, F.running, 0);
+	}
+	
+#ifndef FORTH_NO_TASKS
+	if (F.errhandlers == 1 && F.task) {	// the error leaves the host call, the task can't be resumed
+		unlinktask(F.task);
+		loadtask(0);			// the host continues with the stacks of the task it called
+	}
+#endif
+	
+	if (F.errhandlers)
+		longjmp(F.errjmp, 1);
+	else
+		abort();
+}
+
+
+void fth_push(int x)
+{
+	check(F.sp >= STACK_SIZE, "stack overflow");
+	F.stack[F.sp++] = x;
+	PEAK(F.stats.sppeak, F.sp);
+}
+
+
+int fth_pop(void)
+{
+	check(F.sp <= 0, "stack underflow");
+	return F.stack[--F.sp];
+}
+
+
+int fth_fetch(int a)
+{
+#ifdef FORTH_ALIGNMENT_HACK
+	int x;
+	memcpy(&x, dataarea(a, sizeof(int), 0), sizeof(int));
+	return x;
+#else
+	return *(int *)dataarea(a, sizeof(int), 0);
+#endif
+}
+
+
+void fth_store(int a, int x)
+{
+#ifdef FORTH_ALIGNMENT_HACK
+	memcpy(dataarea(a, sizeof(int), 1), &x, sizeof(int));
+#else
+	*(int *)dataarea(a, sizeof(int), 1) = x;
+#endif
+}
+
+
+char fth_cfetch(int a)
+{
+	return *dataarea(a, 1, 0);
+}
+
+
+void fth_cstore(int a, char x)
+{
+	*dataarea(a, 1, 1) = x;
+}
+
+
+char *fth_area(int a, int size)
+{
+#ifndef FORTH_NO_CHECKPOINTS
+	if (F.dirtymap && !invaliddataaddr(a) && !invaliddataaddr(a + size))
+		return dirty(a, size);		// the host may write through the pointer
+#endif
+	return dataarea(a, size, 0);
+}
+
+
+int fth_length(int a)
+{
+	char *s, *end;
+	
+	if (!invaliddataaddr(a))
+		return strlen(&F.data[a]);		// data area always ends with 0
+	
+	s = mapped(a, 1, 0);
+	end = memchr(s, 0, F.maps[MAPINDEX(a)].size - MAPOFFSET(a));
+	check(!end, "unterminated string at %d", a);
+	return end - s;
+}
+
+
+long long fth_nanotime(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER count, freq;
+	
+	QueryPerformanceCounter(&count);
+	QueryPerformanceFrequency(&freq);
+	return count.QuadPart / freq.QuadPart * 1000000000LL + count.QuadPart % freq.QuadPart * 1000000000LL / freq.QuadPart;
+#else
+	struct timespec ts;
+	
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+#endif
+}
+
+
+static char *mapped(int a, int size, int write)
+{
+	int i = MAPINDEX(a);
+	
+	check(a < MAP_FIRST || i >= MAPS_MAX || !F.maps[i].ptr || size < 0 || MAPOFFSET(a) + size > F.maps[i].size, "invalid data area %d (%d bytes)", a, size);
+	check(write && F.maps[i].readonly, "attempt to write read-only data area %d", a);
+	return F.maps[i].ptr + MAPOFFSET(a);
+}
+
+
+int fth_map(void *ptr, int size, int readonly)
+{
+	int i;
+	
+	if (!ptr || size <= 0 || size > MAP_SPAN)
+		return 0;
+	
+	for (i = 0; i < MAPS_MAX; i++)
+		if (!F.maps[i].ptr) {
+			F.maps[i].ptr = (char *)ptr;
+			F.maps[i].size = size;
+			F.maps[i].readonly = readonly;
+			return MAP_FIRST + i * MAP_SPAN;
+		}
+	
+	return 0;
+}
+
+
+void fth_unmap(int a)
+{
+	int i = MAPINDEX(a);
+	
+	check(a < MAP_FIRST || i >= MAPS_MAX || MAPOFFSET(a) != 0 || !F.maps[i].ptr, "%d is not a mapped region", a);
+	F.maps[i].ptr = NULL;
+}
+
+
+static void allocareas(primitives_f app_primitives, notfound_f app_notfnd)
+{
+	F.app_prims = app_primitives;
+	F.app_notfound = app_notfnd;
+	F.app_funcs = NULL;
+	F.code = (int *)malloc(CODE_INITIAL_SIZE * sizeof(int));
+	check(!F.code, "");
+	F.codecap = CODE_INITIAL_SIZE * sizeof(int);
+	F.data = (char *)malloc(DATA_INITIAL_SIZE);
+	check(!F.data, "");
+	F.datacap = DATA_INITIAL_SIZE;
+	F.dict = (word_t *)malloc(DICT_INITIAL_SIZE * sizeof(word_t));
+	check(!F.dict, "");
+	F.dictcap = DICT_INITIAL_SIZE * sizeof(word_t);
+	F.names = (char *)malloc(NAMES_INITIAL_SIZE);
+	check(!F.names, "");
+	F.namescap = NAMES_INITIAL_SIZE;
+	F.codeindex = (codeindex_t *)malloc(DICT_INITIAL_SIZE * sizeof(codeindex_t));
+	check(!F.codeindex, "");
+	F.codeindexcap = DICT_INITIAL_SIZE * sizeof(codeindex_t);
+	F.codeindexp = 0;
+#ifndef FORTH_NO_CLONES
+	F.coderefs = F.dictrefs = F.namesrefs = F.codeindexrefs = NULL;
+#endif
+#ifndef FORTH_NO_BUDGET
+	F.fuel = FUEL_CHUNK;
+	F.budget = -1;
+	F.deadline = 0;
+#endif
+#ifndef FORTH_NO_CHECKPOINTS
+	F.ckdata = NULL;
+	F.dirtymap = NULL;
+	F.dirtyblocks = NULL;
+	F.patches = NULL;
+	F.ndirty = F.patchp = F.patchescap = 0;
+#endif
+	F.data[DATA_INITIAL_SIZE - 1] = '\0';
+	memset(F.maps, 0, sizeof(F.maps));
+	memset(&F.stats, 0, sizeof(F.stats));
+#ifndef FORTH_NO_OUTPUT
+	F.outp = 0;
+	F.outmode = FORTH_FLUSH_FULL;
+	F.output = NULL;
+	F.outudata = NULL;
+	F.holdp = HOLD_SIZE;
+#endif
+#ifndef FORTH_NO_TASKS
+	F.tasks = NULL;
+	F.taskp = F.taskscap = 0;
+	F.task = 0;
+#endif
+#ifndef FORTH_NO_RESUMABLE
+	F.resumables = NULL;
+	F.resumablep = F.resumablescap = 0;
+	F.resuming = F.resumelevel = F.stepyield = 0;
+#endif
+#ifdef FORTH_THREADS
+	F.worker = 0;
+#endif
+#ifdef FORTH_REACTOR
+	F.epollfd = -1;
+	F.watches = NULL;
+	F.watchescap = F.nwatches = 0;
+	F.timers = NULL;
+	F.timerp = F.timerscap = 0;
+	F.lasttimer = 0;
+	F.stopevents = 0;
+#endif
+#ifndef FORTH_NO_TRACER
+	F.tracemask = 0;
+	F.trace = NULL;
+	F.tracecap = 0;
+	F.tracecount = 0;
+#endif
+#ifndef FORTH_NO_PROFILER
+	F.profiling = 0;
+	F.profile = NULL;
+	F.profilesize = 0;
+	F.psp = 0;
+#endif
+#ifdef FORTH_OPSTATS
+	F.opstats = (long long *)calloc(NUM_OPSTATS + NUM_OPSTATS * NUM_OPSTATS, sizeof(long long));
+	check(!F.opstats, "");
+	F.lastop = -1;
+#endif
+#ifdef FORTH_SAMPLER
+	F.samples = NULL;
+	F.samplecap = 0;
+	F.samplecount = 0;
+#endif
+}
+
+
+void fth_init(primitives_f app_primitives, notfound_f app_notfnd)
+{
+#ifdef FORTH_STATIC_CORE
+	fth_initimage(&core_image, app_primitives, app_notfnd);
+#else
+	allocareas(app_primitives, app_notfnd);
+	reset();
+	F.cp = F.dp = 1;		// 0 is an "invalid" address
+	F.errhandlers = 0;
+	
+	// initial vocabulary
+	F.namesp = 0;
+	F.dictp = 1;
+	F.context = F.current = 0;
+	F.code[0] = 0;
+	create("FORTH", 0, DOVOCABULARY);
+	F.context = F.current = F.forth_voc = F.cp;
+	compile(1);
+	compile(0);
+	
+	// core xt-s
+	F.lit_xt = F.cp;		compile(LIT);
+	F.branch_xt = F.cp;		compile(BRANCH);
+	F.qbranch_xt = F.cp;		compile(QBRANCH);
+	F.dodo_xt = F.cp;		compile(DODO);
+	F.doqdo_xt = F.cp;		compile(DOQDO);
+	F.doloop_xt = F.cp;		compile(DOLOOP);
+	F.doaddloop_xt = F.cp;		compile(DOADDLOOP);
+	F.dotry_xt = F.cp;		compile(DOTRY);
+	F.litxt_xt = F.cp;		compile(LITXT);
+	F.parloop_xt = F.cp;		compile(DOPARLOOP);
+	
+	fth_library(core_words);
+	
+	F.exit_xt = find("EXIT")->xt;
+	F.codecomma_xt = find("CODE,")->xt;
+	F.store_xt = find("!")->xt;
+	reindex();
+#endif
+}
+
+
+void fth_initimage(const forth_image_t *img, primitives_f app_primitives, notfound_f app_notfnd)
+{
+	allocareas(app_primitives, app_notfnd);
+	check(!reserve((void **)&F.code, &F.codecap, img->cp * sizeof(int), 0), "unable to expand code area for image");
+	memcpy(F.code, img->code, img->cp * sizeof(int));
+	F.cp = img->cp;
+	check(!reserve((void **)&F.data, &F.datacap, img->dp, 0), "unable to expand data area for image");
+	memcpy(F.data, img->data, img->dp);
+	F.dp = img->dp;
+	check(!reserve((void **)&F.dict, &F.dictcap, img->dictp * sizeof(word_t), 0), "unable to expand dictionary area for image");
+	memcpy(F.dict, img->dict, img->dictp * sizeof(word_t));
+	F.dictp = img->dictp;
+	check(!reserve((void **)&F.names, &F.namescap, img->namesp, 0), "unable to expand names area for image");
+	memcpy(F.names, img->names, img->namesp);
+	F.namesp = img->namesp;
+	F.forth_voc = img->forth_voc;
+	
+	F.lit_xt = img->lit_xt;
+	F.exit_xt = img->exit_xt;
+	F.branch_xt = img->branch_xt;
+	F.qbranch_xt = img->qbranch_xt;
+	F.dodo_xt = img->dodo_xt;
+	F.doqdo_xt = img->doqdo_xt;
+	F.doloop_xt = img->doloop_xt;
+	F.doaddloop_xt = img->doaddloop_xt;
+	F.codecomma_xt = img->codecomma_xt;
+	F.store_xt = img->store_xt;
+	F.dotry_xt = img->dotry_xt;
+	F.litxt_xt = img->litxt_xt;
+	F.parloop_xt = img->parloop_xt;
+	reindex();
+	
+	reset();
+	F.errhandlers = 0;
+}
+
+
+void fth_free(void)
+{
+#ifndef FORTH_NO_OUTPUT
+	fth_flush();
+#endif
+	release(F.code, &F.coderefs);
+	free(F.data);
+	release(F.dict, &F.dictrefs);
+	release(F.names, &F.namesrefs);
+	release(F.codeindex, &F.codeindexrefs);
+	free(F.app_funcs);
+#ifndef FORTH_NO_CHECKPOINTS
+	dropcheckpoint();
+#endif
+#ifndef FORTH_NO_PROFILER
+	free(F.profile);
+#endif
+#ifdef FORTH_OPSTATS
+	free(F.opstats);
+#endif
+#ifdef FORTH_SAMPLER
+	fth_stopsampling();
+	free(F.samples);
+#endif
+#ifndef FORTH_NO_TRACER
+	free(F.trace);
+#endif
+#ifndef FORTH_NO_TASKS
+	free(F.tasks);
+#endif
+#ifndef FORTH_NO_RESUMABLE
+	free(F.resumables);
+#endif
+#ifdef FORTH_REACTOR
+	if (F.epollfd >= 0)
+		close(F.epollfd);
+	free(F.watches);
+	free(F.timers);
+#endif
+}
+
+
+#ifndef FORTH_NO_CLONES
+int fth_clone(forth_t *parent)
+{
+	int **refs[4] = {&parent->coderefs, &parent->dictrefs, &parent->namesrefs, &parent->codeindexrefs};
+	char *data = (char *)malloc(parent->datacap);
+	app_func_t *funcs = NULL;
+#  ifndef FORTH_NO_TASKS
+	task_t *tasks = NULL;
+#  endif
+#  ifdef FORTH_OPSTATS
+	long long *opstats = (long long *)calloc(NUM_OPSTATS + NUM_OPSTATS * NUM_OPSTATS, sizeof(long long));
+	int ok = data && opstats;
+#  else
+	int ok = data != NULL;
+#  endif
+	int i;
+	
+	if (parent == &F)
+		ok = 0;
+	if (ok && parent->app_funcs)
+		ok = (funcs = (app_func_t *)malloc(CORE_PRIM_FIRST * sizeof(app_func_t))) != NULL;
+#  ifndef FORTH_NO_TASKS
+	if (ok && parent->tasks)
+		ok = (tasks = (task_t *)malloc(parent->taskscap)) != NULL;
+#  endif
+	for (i = 0; i < 4 && ok; i++)
+		if (!*refs[i]) {
+			int *r = (int *)malloc(sizeof(int));
+			
+			if (!r) {
+				ok = 0;
+				break;
+			}
+			*r = 1;
+#  ifdef FORTH_THREADS
+			{
+				int *none = NULL;
+				
+				if (!__atomic_compare_exchange_n(refs[i], &none, r, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+					free(r);
+			}
+#  else
+			*refs[i] = r;
+#  endif
+		}
+	if (!ok) {
+		free(data);
+		free(funcs);
+#  ifndef FORTH_NO_TASKS
+		free(tasks);
+#  endif
+#  ifdef FORTH_OPSTATS
+		free(opstats);
+#  endif
+		return 0;
+	}
+	
+	// code, dictionary, names and code index are shared, the rest is copied or starts empty
+	memcpy(&F, parent, sizeof(forth_t));
+	for (i = 0; i < 4; i++)
+		REFADD(*refs[i], 1);
+	memcpy(data, parent->data, parent->dp);
+	data[parent->datacap - 1] = '\0';
+	F.data = data;
+	if (funcs)
+		memcpy(funcs, parent->app_funcs, CORE_PRIM_FIRST * sizeof(app_func_t));
+	F.app_funcs = funcs;
+#  ifndef FORTH_NO_TASKS
+	if (tasks)
+		memcpy(tasks, parent->tasks, parent->taskscap);
+	F.tasks = tasks;
+#  endif
+#  ifndef FORTH_NO_RESUMABLE
+	F.resumables = NULL;			// handles belong to the instance that started them
+	F.resumablep = F.resumablescap = 0;
+	F.resuming = F.resumelevel = F.stepyield = 0;
+#  endif
+	F.errhandlers = 0;
+#  ifndef FORTH_NO_CHECKPOINTS
+	F.ckdata = NULL;
+	F.dirtymap = NULL;
+	F.dirtyblocks = NULL;
+	F.patches = NULL;
+	F.ndirty = F.patchp = F.patchescap = 0;
+#  endif
+#  ifndef FORTH_NO_OUTPUT
+	F.outp = 0;
+#  endif
+#  ifdef FORTH_THREADS
+	F.worker = 0;
+#  endif
+#  ifdef FORTH_REACTOR
+	F.epollfd = -1;
+	F.watches = NULL;
+	F.watchescap = F.nwatches = 0;
+	F.timers = NULL;
+	F.timerp = F.timerscap = 0;
+#  endif
+#  ifndef FORTH_NO_TRACER
+	F.tracemask = 0;
+	F.trace = NULL;
+	F.tracecap = 0;
+	F.tracecount = 0;
+#  endif
+#  ifndef FORTH_NO_PROFILER
+	F.profiling = 0;
+	F.profile = NULL;
+	F.profilesize = 0;
+	F.psp = 0;
+#  endif
+#  ifdef FORTH_OPSTATS
+	F.opstats = opstats;
+	F.lastop = -1;
+#  endif
+#  ifdef FORTH_SAMPLER
+	F.samples = NULL;
+	F.samplecap = 0;
+	F.samplecount = 0;
+#  endif
+	return 1;
+}
+#endif
+
+
+#ifndef FORTH_NO_BUDGET
+void fth_setbudget(long long steps, int ms)
+{
+	F.budget = steps > 0 ? steps : -1;
+	F.fuel = 0;				// the next step takes the first chunk of the budget
+	F.deadline = ms > 0 ? fth_nanotime() + ms * 1000000LL : 0;
+}
+
+
+long long fth_getfuel(void)
+{
+	return F.budget < 0 ? -1 : F.budget + (F.fuel > 0 ? F.fuel : 0);
+}
+#endif
+
+
+#ifndef FORTH_NO_CHECKPOINTS
+int fth_checkpoint(void)
+{
+	int nblocks = (F.dp + DIRTY_BLOCK - 1) / DIRTY_BLOCK;
+	char *data = (char *)malloc(F.dp);
+	unsigned char *map = (unsigned char *)calloc(nblocks + 1, 1);
+	int *blocks = (int *)malloc((nblocks + 1) * sizeof(int));
+	patch_entry_t *patches = (patch_entry_t *)malloc(16 * sizeof(patch_entry_t));
+	
+	if (!data || !map || !blocks || !patches) {
+		free(data);
+		free(map);
+		free(blocks);
+		free(patches);
+		return 0;
+	}
+	dropcheckpoint();
+	memcpy(data, F.data, F.dp);
+	F.ckdata = data;
+	F.dirtymap = map;
+	F.dirtyblocks = blocks;
+	F.patches = patches;
+	F.patchescap = 16 * sizeof(patch_entry_t);
+	F.ckcp = F.cp;
+	F.ckdp = F.dp;
+	F.ckdictp = F.dictp;
+	F.cknamesp = F.namesp;
+	F.ckcodeindexp = F.codeindexp;
+	F.ckcontext = F.context;
+	F.ckcurrent = F.current;
+#  ifndef FORTH_NO_TASKS
+	F.cktaskp = F.taskp;
+#  endif
+#  ifndef FORTH_NO_PROFILER
+	F.ckprofiling = F.profiling;
+#  endif
+#  ifndef FORTH_NO_TRACER
+	F.cktracemask = F.tracemask;
+#  endif
+#  ifdef FORTH_SAMPLER
+	F.cksampling = sampling;
+#  endif
+	while ((F.ckserial = __atomic_add_fetch(&ckserials, 1, __ATOMIC_RELAXED)) == 0)
+		;
+	return 1;
+}
+
+
+int fth_restore(void)
+{
+	int i;
+	
+	if (!F.dirtymap)
+		return 0;
+	if (F.patchp > 0 && (!reserve((void **)&F.code, &F.codecap, 0, 0) || !reserve((void **)&F.dict, &F.dictcap, 0, 0)))
+		return 0;
+	
+	for (i = F.patchp - 1; i >= 0; i--)
+		if (F.patches[i].a > 0)
+			F.code[F.patches[i].a] = F.patches[i].x;
+		else
+			F.dict[-F.patches[i].a].flags = F.patches[i].x;
+	F.patchp = 0;
+	
+	for (i = 0; i < F.ndirty; i++) {
+		int b = F.dirtyblocks[i], start = b * DIRTY_BLOCK;
+		
+		memcpy(F.data + start, F.ckdata + start, start + DIRTY_BLOCK < F.ckdp ? DIRTY_BLOCK : F.ckdp - start);
+		F.dirtymap[b] = 0;
+	}
+	F.ndirty = 0;
+	
+	F.cp = F.ckcp;
+	F.dp = F.ckdp;
+	F.dictp = F.ckdictp;
+	F.namesp = F.cknamesp;
+	F.codeindexp = F.ckcodeindexp;
+#  ifndef FORTH_NO_TASKS
+	F.taskp = F.cktaskp;
+#  endif
+	reset();
+	F.context = F.ckcontext;
+	F.current = F.ckcurrent;
+	
+	// state kept outside the areas: channels, profiler, tracer, sampler and pictured output
+#  ifndef FORTH_NO_CHANNELS
+	for (i = 0; i < CHANNELS_MAX; i++) {
+		channel_t *c = __atomic_load_n(&channels[i], __ATOMIC_ACQUIRE);
+		
+		if (c && c->checkpoint == F.ckserial)
+			fth_freechannel(i + 1);
+	}
+#  endif
+#  ifndef FORTH_NO_PROFILER
+	F.profiling = F.ckprofiling;
+	fth_resetprofile();
+#  endif
+#  ifndef FORTH_NO_TRACER
+	F.tracemask = F.cktracemask;
+	F.tracecount = 0;
+#  endif
+#  ifdef FORTH_SAMPLER
+	if (!F.cksampling)
+		fth_stopsampling();
+	F.samplecount = 0;
+#  endif
+#  ifndef FORTH_NO_OUTPUT
+	F.holdp = HOLD_SIZE;
+#  endif
+	return 1;
+}
+#endif
+
+
+void fth_primitive(const char *name, int code, int immediate)
+{
+	create(name, immediate ? IMMEDIATE : 0, code);
+}
+
+
+void fth_bindprimitive(int code, primfunc_f func, void *udata)
+{
+	check(code < 0 || code >= CORE_PRIM_FIRST, "invalid application opcode: %d", code);
+	if (!F.app_funcs) {
+		F.app_funcs = (app_func_t *)calloc(CORE_PRIM_FIRST, sizeof(app_func_t));
+		check(!F.app_funcs, "unable to allocate primitives table");
+	}
+	F.app_funcs[code].func = func;
+	F.app_funcs[code].udata = udata;
+}
+
+
+void fth_primitivefunc(const char *name, int code, primfunc_f func, void *udata, int immediate)
+{
+	fth_bindprimitive(code, func, udata);
+	create(name, immediate ? IMMEDIATE : 0, code);
+}
+
+
+int fth_interpret(const char *s)
+{
+	const char *osource = F.source;
+	int ointp = F.intp;
+	jmp_buf oerr;
+	int ret;
+	
+	memcpy(oerr, F.errjmp, sizeof(jmp_buf));
+	F.errhandlers++;
+	if (setjmp(F.errjmp) == 0) {
+		F.source = s;
+		F.intp = 0;
+		do_interpret();
+		ret = 1;
+		F.intp = ointp;
+		F.source = osource;
+	} else {
+		ret = 0;
+	}
+	memcpy(F.errjmp, oerr, sizeof(jmp_buf));
+	F.errhandlers--;
+	return ret;
+}
+
+
+int fth_execute(const char *w)
+{
+	word_t *pw;
+	jmp_buf oerr;
+	int ret;
+	
+	memcpy(oerr, F.errjmp, sizeof(jmp_buf));
+	F.errhandlers++;
+	if (setjmp(F.errjmp) == 0) {
+		pw = find(w);
+		check(pw == NULL, "%s ?", w);
+		execute(pw->xt);
+		ret = 1;
+	} else {
+		ret = 0;
+	}
+	
+	memcpy(F.errjmp, oerr, sizeof(jmp_buf));
+	F.errhandlers--;
+	return ret;
+}
+
+
+int fth_lookup(const char *w)
+{
+	word_t *pw = find(w);
+	
+	return pw ? pw->xt : 0;
+}
+
+
+static void call(int xt, const int *args, int nargs, int *results, int nresults)
+{
+	check(F.sp + nargs > STACK_SIZE, "stack overflow");
+	memcpy(&F.stack[F.sp], args, nargs * sizeof(int));
+	F.sp += nargs;
+	PEAK(F.stats.sppeak, F.sp);
+	execute(xt);
+	check(F.sp < nresults, "stack underflow");
+	F.sp -= nresults;
+	memcpy(results, &F.stack[F.sp], nresults * sizeof(int));
+}
+
+
+int fth_call(int xt, const int *args, int nargs, int *results, int nresults)
+{
+	jmp_buf oerr;
+	int ret;
+	
+	if (nargs < 0 || nresults < 0)
+		return 0;
+	if (F.errhandlers)		// no need to keep the handler of the outermost call
+		memcpy(oerr, F.errjmp, sizeof(jmp_buf));
+	F.errhandlers++;
+	if (setjmp(F.errjmp) == 0) {
+		checkcode(xt);
+		call(xt, args, nargs, results, nresults);
+		ret = 1;
+	} else {
+		ret = 0;
+	}
+	
+	if (--F.errhandlers)
+		memcpy(F.errjmp, oerr, sizeof(jmp_buf));
+	return ret;
+}
+
+
+int fth_callbatch(int xt, const int *args, int nargs, int *results, int nresults, int count)
+{
+	jmp_buf oerr;
+	volatile int done = 0;
+	
+	if (nargs < 0 || nresults < 0)
+		return 0;
+	if (F.errhandlers)
+		memcpy(oerr, F.errjmp, sizeof(jmp_buf));
+	F.errhandlers++;
+	if (setjmp(F.errjmp) == 0) {
+		checkcode(xt);
+		for (; done < count; done++)
+			call(xt, &args[done * nargs], nargs, &results[done * nresults], nresults);
+	}
+	
+	if (--F.errhandlers)
+		memcpy(F.errjmp, oerr, sizeof(jmp_buf));
+	return done;
+}
+
+
+void fth_library(primitive_word_t *lib)
+{
+	int i;
+	
+	for (i = 0; lib[i].name; i++)
+		fth_primitive(lib[i].name, lib[i].code, lib[i].immediate);
+}
+
+
+void fth_libraryfunc(primitive_func_t *lib)
+{
+	int i;
+	
+	for (i = 0; lib[i].name; i++)
+		fth_primitivefunc(lib[i].name, lib[i].code, lib[i].func, lib[i].udata, lib[i].immediate);
+}
+
+
+void fth_bindlibrary(primitive_func_t *lib)
+{
+	int i;
+	
+	for (i = 0; lib[i].name; i++)
+		fth_bindprimitive(lib[i].code, lib[i].func, lib[i].udata);
+}
+
+
+int fth_getstate(void)
+{
+	return F.state;
+}
+
+
+void fth_reset(void)
+{
+	TRACEUNWIND(0);
+	F.sp = F.rsp = F.lsp = F.cfsp = 0;
+#ifndef FORTH_NO_PROFILER
+	profileunwind(0);
+#endif
+	F.running = 0;
+#ifndef FORTH_NO_TASKS
+	if (F.tasks) {
+		int i;
+		
+		for (i = 1; i < F.taskp; i++)
+			F.tasks[i].next = F.tasks[i].prev = -1;
+		F.tasks[0].next = F.tasks[0].prev = 0;
+	}
+	F.task = 0;
+#endif
+	F.errormsg[0] = 0;
+	F.errhandlers = 0;
+	F.state = 0;
+	F.context = F.current = F.forth_voc;
+}
+
+
+const char *fth_geterror(void)
+{
+	return F.errormsg;
+}
+
+
+int fth_getdepth(void)
+{
+	return F.sp;
+}
+
+
+int fth_getstack(int idx)
+{
+	if (idx >= 0 && idx < F.sp)
+		return F.stack[idx];
+	else
+		return 0;
+}
+
+
+const char *fth_geterrorline(int *plen, int *pintp, int *plineno)
+{
+	int line = 1, beg = 0, end, i;
+	
+	if (!F.source)
+		return NULL;
+	
+	if (F.intp > 0)
+		F.intp--;
+	
+	while (F.intp > 0 && (F.intp == strlen(F.source) || ISSEP(' ', CURCHAR)))
+		F.intp--;
+	
+	for (i = 0; i < F.intp; i++)
+		if (F.source[i] == '\n') {
+			line++;
+			beg = i + 1;
+		}
+	
+	for (; i < strlen(F.source); i++)
+		if (F.source[i] == '\n')
+			break;
+	end = i;
+	
+	if (plen)
+		*plen = end - beg;
+	if (pintp)
+		*pintp = F.intp - beg;
+	if (plineno)
+		*plineno = line;
+	return &F.source[beg];
+}
+
+
+void fth_getstats(forth_stats_t *st)
+{
+	*st = F.stats;
+	st->sp = F.sp;
+	st->stacksize = STACK_SIZE;
+	st->rsp = F.rsp;
+	st->rstacksize = RSTACK_SIZE;
+	st->lsp = F.lsp;
+	st->lstacksize = LSTACK_SIZE;
+	st->cfsp = F.cfsp;
+	st->cfstacksize = CFSTACK_SIZE;
+	st->cp = F.cp;
+	st->codecap = F.codecap / sizeof(int);
+	st->dp = F.dp;
+	st->datacap = F.datacap;
+	st->dictp = F.dictp;
+	st->dictcap = F.dictcap / sizeof(word_t);
+	st->namesp = F.namesp;
+	st->namescap = F.namescap;
+	
+	// pointers set directly by loading and initialization
+	PEAK(st->cppeak, st->cp);
+	PEAK(st->dppeak, st->dp);
+	PEAK(st->dictppeak, st->dictp);
+	PEAK(st->namesppeak, st->namesp);
+}
+
+
+void fth_resetstats(void)
+{
+	memset(&F.stats, 0, sizeof(F.stats));
+	F.stats.sppeak = F.sp;
+	F.stats.rsppeak = F.rsp;
+	F.stats.lsppeak = F.lsp;
+	F.stats.cfsppeak = F.cfsp;
+	F.stats.cppeak = F.cp;
+	F.stats.dppeak = F.dp;
+	F.stats.dictppeak = F.dictp;
+	F.stats.namesppeak = F.namesp;
+}
+
+
+int fth_gettracedepth(void)
+{
+	return F.rsp;
+}
+
+
+const char *fth_gettrace(int idx)
+{
+	int xt;
+	const char *name;
+	
+	if (idx < 0 || idx >= F.rsp)
+		return "<invalid backtrace index>";
+	
+	if (idx == F.rsp - 1)
+		xt = F.running;
+	else
+		xt = F.rstack[idx + 1].xt;
+	
+	name = xtname(xt);
+	return name ? name : "<unknown>";
+}
+
+
+const char *fth_codename(int a, int *pstart)
+{
+	codeindex_t *c = codeowner(a);
+	
+	if (!c)
+		return NULL;
+	if (pstart)
+		*pstart = c->xt;
+	return ownername(c);
+}
+
+
+#ifndef FORTH_NO_OUTPUT
+void fth_setoutput(output_f sink, void *udata, int mode)
+{
+	fth_flush();
+	F.output = sink;
+	F.outudata = udata;
+	F.outmode = mode;
+}
+
+
+// Passes the buffered output to the sink. Parallel loop workers pass only whole lines, so that
+// lines of different workers don't mix, unless the buffer is full or the part is done (whole)
+static void flushout(int whole)
+{
+	int n = F.outp;
+	
+#ifdef FORTH_THREADS
+	if (F.worker && !whole) {
+		while (n > 0 && F.out[n - 1] != '\n')
+			n--;
+		if (n == 0 && F.outp < OUTPUT_BUFFER_SIZE)
+			return;
+		if (n == 0)
+			n = F.outp;
+	}
+#endif
+	if (n == 0)
+		return;
+#ifdef FORTH_THREADS
+	if (F.worker)
+		pthread_mutex_lock(&pool.output);
+#endif
+	if (F.output) {
+		F.output(F.out, n, F.outudata);
+	} else {
+		fwrite(F.out, 1, n, stdout);
+		fflush(stdout);
+	}
+#ifdef FORTH_THREADS
+	if (F.worker)
+		pthread_mutex_unlock(&pool.output);
+#endif
+	F.outp -= n;
+	if (F.outp > 0)
+		memmove(F.out, &F.out[n], F.outp);
+}
+
+
+void fth_flush(void)
+{
+	flushout(0);
+}
+
+
+void fth_emit(char c)
+{
+	if (F.outp == OUTPUT_BUFFER_SIZE)
+		fth_flush();
+	F.out[F.outp++] = c;
+	if (c == '\n' && F.outmode == FORTH_FLUSH_LINE)
+		fth_flush();
+}
+
+
+void fth_type(const char *s, int len)
+{
+	int flush = F.outmode == FORTH_FLUSH_LINE && len > 0 && memchr(s, '\n', len), n;
+	
+	while (len > 0) {
+		if (F.outp == OUTPUT_BUFFER_SIZE)
+			fth_flush();
+		n = OUTPUT_BUFFER_SIZE - F.outp;
+		if (n > len)
+			n = len;
+		memcpy(&F.out[F.outp], s, n);
+		F.outp += n;
+		s += n;
+		len -= n;
+	}
+	if (flush)
+		fth_flush();
+}
+
+
+void fth_typenumber(int x, int base)
+{
+	char buf[40], *end = &buf[sizeof(buf)], *s;
+	
+	check(base < 2 || base > 36, "invalid number base %d", base);
+	if (base == 10 && x < 0) {
+		s = formatnumber(end, -(unsigned)x, base);
+		*--s = '-';
+	} else {
+		s = formatnumber(end, x, base);
+	}
+	fth_type(s, end - s);
+}
+#endif
+
+
+#ifndef FORTH_NO_TASKS
+void fth_pause(void)
+{
+	int next;
+	
+	if (!F.tasks || (next = F.tasks[F.task].next) == F.task)
+		return;
+	check(F.errhandlers != 1, "PAUSE is not allowed inside TRY or nested call");
+#  ifndef FORTH_NO_RESUMABLE
+	check(F.resuming, "PAUSE is not allowed inside resumable execution");
+#  endif
+	savetask(&F.tasks[F.task]);
+	loadtask(next);
+}
+#endif
+
+
+#ifndef FORTH_NO_RESUMABLE
+static resumable_t *resumable(int handle)
+{
+	if (handle <= 0 || handle >= F.resumablep)
+		return NULL;
+	if (F.resumables[handle].status == RESUMABLE_FREE || F.resumables[handle].status == RESUMABLE_RUNNING)
+		return NULL;
+	return &F.resumables[handle];
+}
+
+
+int fth_start(int xt, const int *args, int nargs)
+{
+	resumable_t *r;
+	int h;
+	
+	if (nargs < 0 || nargs > STACK_SIZE)
+		return 0;
+	if (xt <= 0 || xt >= F.cp)		// 0 also marks a started execution
+		return 0;
+	if (!F.resumables) {
+		F.resumables = (resumable_t *)malloc(2 * sizeof(resumable_t));
+		if (!F.resumables)
+			return 0;
+		F.resumablescap = 2 * sizeof(resumable_t);
+		F.resumables[0].nextfree = 0;
+		F.resumablep = 1;
+	}
+	
+	if ((h = F.resumables[0].nextfree) != 0)
+		F.resumables[0].nextfree = F.resumables[h].nextfree;
+	else if (reserve((void **)&F.resumables, &F.resumablescap, F.resumablep * sizeof(resumable_t), sizeof(resumable_t)))
+		h = F.resumablep++;
+	else
+		return 0;
+	
+	// the word is executed by the first fth_resume(), so any compiled xt can be started
+	r = &F.resumables[h];
+	memcpy(r->state.stack, args, nargs * sizeof(int));
+	r->state.sp = nargs;
+	r->state.rsp = r->state.lsp = 0;
+	r->state.ip = r->state.running = 0;
+	r->xt = xt;
+	r->status = FORTH_YIELDED;
+	return h;
+}
+
+
+int fth_resume(int handle, long long maxsteps)
+{
+	jmp_buf oerr;
+	task_t host;
+	resumable_t *r = resumable(handle);
+	int oresuming = F.resuming, olevel = F.resumelevel;
+#  ifndef FORTH_NO_TASKS
+	int otask = F.task;
+#  endif
+#  ifndef FORTH_NO_BUDGET
+	int ofuel = F.fuel, ostepyield = F.stepyield;
+	long long obudget = F.budget;
+#  endif
+
+	if (!r || r->status != FORTH_YIELDED)
+		return FORTH_ERROR;
+	
+	// the caller may be a primitive of a running definition, its state is put aside
+	savetask(&host);
+	loadstate(&r->state);
+	r->status = RESUMABLE_RUNNING;
+	F.resuming = handle;
+#  ifndef FORTH_NO_TASKS
+	F.task = 0;			// not a task, leaving its last definition doesn't stop anything
+#  endif
+#  ifndef FORTH_NO_BUDGET
+	// with a step limit the execution has a budget of its own, otherwise it spends the caller's one
+	F.stepyield = maxsteps > 0;
+	if (maxsteps > 0) {
+		F.budget = maxsteps;
+		F.fuel = 0;
+	}
+#  endif
+
+	if (F.errhandlers)
+		memcpy(oerr, F.errjmp, sizeof(jmp_buf));
+	F.resumelevel = ++F.errhandlers;
+	if (setjmp(F.errjmp) == 0) {
+		int xt = F.resumables[handle].xt;
+		
+		if (xt) {
+			F.resumables[handle].xt = 0;
+			checkcode(xt);
+			execute(xt);
+		} else {
+			run(0);
+		}
+		F.resumables[handle].status = FORTH_DONE;
+	}
+	
+	// the execution could have started others and moved the handles
+	r = &F.resumables[handle];
+	if (r->status == RESUMABLE_RUNNING)
+		r->status = FORTH_ERROR;
+	if (r->status != FORTH_YIELDED)
+		savetask(&r->state);	// the stack keeps the results
+	
+	if (--F.errhandlers)
+		memcpy(F.errjmp, oerr, sizeof(jmp_buf));
+	loadstate(&host);
+	F.resuming = oresuming;
+	F.resumelevel = olevel;
+#  ifndef FORTH_NO_TASKS
+	F.task = otask;
+#  endif
+#  ifndef FORTH_NO_BUDGET
+	if (maxsteps > 0) {
+		F.budget = obudget;
+		F.fuel = ofuel;
+	}
+	F.stepyield = ostepyield;
+#  endif
+	return r->status;
+}
+
+
+int fth_results(int handle, int *results, int nresults)
+{
+	resumable_t *r = resumable(handle);
+	
+	if (!r || nresults < 0 || r->state.sp < nresults)
+		return 0;
+	r->state.sp -= nresults;
+	memcpy(results, &r->state.stack[r->state.sp], nresults * sizeof(int));
+	return 1;
+}
+
+
+void fth_discard(int handle)
+{
+	resumable_t *r = resumable(handle);
+	
+	if (!r)
+		return;
+	r->status = RESUMABLE_FREE;
+	r->nextfree = F.resumables[0].nextfree;
+	F.resumables[0].nextfree = handle;
+}
+#endif
+
+
+#ifndef FORTH_NO_CHANNELS
+int fth_newchannel(int capacity, int spsc)
+{
+	channel_t *c;
+	unsigned size = 1, i;
+	
+	check(capacity <= 0 || capacity > 0x1000000, "invalid channel capacity %d", capacity);
+	while (size < (unsigned)capacity)
+		size *= 2;
+	c = (channel_t *)malloc(sizeof(channel_t) + size * sizeof(c->cells[0]));
+	if (!c)
+		return 0;
+	c->head = c->tail = 0;
+	c->sending = 0;
+	c->mask = size - 1;
+	c->spsc = spsc;
+	c->closed = 0;
+	c->checkpoint = 0;
+#ifndef FORTH_NO_CHECKPOINTS
+	if (F.dirtymap)
+		c->checkpoint = F.ckserial;		// freed by fth_restore()
+#endif
+	for (i = 0; i < size; i++)
+		c->cells[i].seq = i;
+	
+	for (i = 0; i < CHANNELS_MAX; i++) {
+		channel_t *expected = NULL;
+		
+		if (__atomic_compare_exchange_n(&channels[i], &expected, c, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+			return i + 1;
+	}
+	free(c);
+	return 0;
+}
+
+
+// Lock-free send: SPSC channels only publish the tail, MPMC channels claim a cell by moving
+// the tail and publish it with the cell sequence number (D. Vyukov's bounded queue).
+// A receiver reports a closed channel only when no send that passed the closed check is
+// still in progress, so messages sent before closing are not lost
+int fth_trysend(int ch, int x, int y)
+{
+	channel_t *c = channel(ch);
+	unsigned pos, seq;
+	int skip;
+	
+	if (c->spsc) {
+		__atomic_store_n(&c->sending, 1, __ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&c->closed, __ATOMIC_SEQ_CST)) {
+			__atomic_store_n(&c->sending, 0, __ATOMIC_RELAXED);
+			return -1;
+		}
+		pos = c->tail;
+		if (pos - __atomic_load_n(&c->head, __ATOMIC_ACQUIRE) > c->mask) {
+			__atomic_store_n(&c->sending, 0, __ATOMIC_RELAXED);
+			return 0;
+		}
+		c->cells[pos & c->mask].x = x;
+		c->cells[pos & c->mask].y = y;
+		__atomic_store_n(&c->tail, pos + 1, __ATOMIC_RELEASE);
+		__atomic_store_n(&c->sending, 0, __ATOMIC_RELEASE);
+		return 1;
+	}
+	
+	if (__atomic_load_n(&c->closed, __ATOMIC_ACQUIRE))
+		return -1;
+	pos = __atomic_load_n(&c->tail, __ATOMIC_RELAXED);
+	for (;;) {
+		seq = __atomic_load_n(&c->cells[pos & c->mask].seq, __ATOMIC_ACQUIRE);
+		if ((int)(seq - pos) == 0) {
+			if (__atomic_compare_exchange_n(&c->tail, &pos, pos + 1, 1, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+				break;
+		} else if ((int)(seq - pos) < 0) {
+			return 0;
+		} else {
+			pos = __atomic_load_n(&c->tail, __ATOMIC_RELAXED);
+		}
+	}
+	// the channel may have been closed after the first check and drained before the claim,
+	// then the claimed cell is published empty and skipped by receivers
+	skip = __atomic_load_n(&c->closed, __ATOMIC_SEQ_CST);
+	c->cells[pos & c->mask].x = x;
+	c->cells[pos & c->mask].y = y;
+	c->cells[pos & c->mask].skip = skip;
+	__atomic_store_n(&c->cells[pos & c->mask].seq, pos + 1, __ATOMIC_RELEASE);
+	return skip ? -1 : 1;
+}
+
+
+int fth_tryrecv(int ch, int *px, int *py)
+{
+	channel_t *c = channel(ch);
+	unsigned pos, seq;
+	int closed = __atomic_load_n(&c->closed, __ATOMIC_SEQ_CST);	// messages sent before closing are still received
+	int skip;
+	
+	if (c->spsc) {
+		if (closed && __atomic_load_n(&c->sending, __ATOMIC_SEQ_CST))
+			return 0;		// the last message may still be published
+		pos = c->head;
+		if (pos == __atomic_load_n(&c->tail, __ATOMIC_ACQUIRE))
+			return closed ? -1 : 0;
+		*px = c->cells[pos & c->mask].x;
+		*py = c->cells[pos & c->mask].y;
+		__atomic_store_n(&c->head, pos + 1, __ATOMIC_RELEASE);
+		return 1;
+	}
+	
+	pos = __atomic_load_n(&c->head, __ATOMIC_RELAXED);
+	for (;;) {
+		seq = __atomic_load_n(&c->cells[pos & c->mask].seq, __ATOMIC_ACQUIRE);
+		if ((int)(seq - (pos + 1)) == 0) {
+			if (__atomic_compare_exchange_n(&c->head, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+				skip = c->cells[pos & c->mask].skip;
+				if (!skip) {
+					*px = c->cells[pos & c->mask].x;
+					*py = c->cells[pos & c->mask].y;
+				}
+				__atomic_store_n(&c->cells[pos & c->mask].seq, pos + c->mask + 1, __ATOMIC_RELEASE);
+				if (!skip)
+					return 1;
+				pos++;
+			}
+		} else if ((int)(seq - (pos + 1)) < 0) {
+			// cells claimed by senders before closing are received once they are published
+			if (closed && pos == __atomic_load_n(&c->tail, __ATOMIC_SEQ_CST))
+				return -1;
+			return 0;
+		} else {
+			pos = __atomic_load_n(&c->head, __ATOMIC_RELAXED);
+		}
+	}
+}
+
+
+void fth_closechannel(int ch)
+{
+	__atomic_store_n(&channel(ch)->closed, 1, __ATOMIC_SEQ_CST);
+}
+
+
+void fth_freechannel(int ch)
+{
+	channel_t *c = channel(ch);
+	
+	__atomic_store_n(&channels[ch - 1], NULL, __ATOMIC_RELEASE);
+	free(c);
+}
+#endif
+
+
+#ifdef FORTH_REACTOR
+int fth_pollevents(int timeout)
+{
+	jmp_buf oerr;
+	volatile int ret;
+	
+	if (F.errhandlers)
+		memcpy(oerr, F.errjmp, sizeof(jmp_buf));
+	F.errhandlers++;
+	if (setjmp(F.errjmp) == 0)
+		ret = pollevents(timeout);
+	else
+		ret = -1;
+	
+	if (--F.errhandlers)
+		memcpy(F.errjmp, oerr, sizeof(jmp_buf));
+	return ret;
+}
+
+
+void fth_stopevents(void)
+{
+	F.stopevents = 1;
+}
+#endif
+
+
+#ifdef FORTH_THREADS
+void fth_setworkers(int n)
+{
+	check(n < 0 || n > WORKERS_MAX, "number of workers must be from 0 to %d", WORKERS_MAX);
+	pool.nworkers = n;
+}
+#endif
+
+
+#ifndef FORTH_NO_PROFILER
+void fth_setprofiling(int on)
+{
+	F.profiling = on;
+}
+
+
+void fth_resetprofile(void)
+{
+	int i;
+	
+	for (i = 0; i < F.profilesize; i++) {
+		F.profile[i].calls = 0;
+		F.profile[i].inclusive = F.profile[i].exclusive = 0;
+	}
+	for (i = 1; i <= F.psp; i++)
+		F.pstack[i].start = fth_nanotime(), F.pstack[i].children = 0;
+}
+
+
+static int profilecmp(const void *a, const void *b)
+{
+	const profile_entry_t *x = a, *y = b;
+	
+	if (x->exclusive != y->exclusive)
+		return x->exclusive < y->exclusive ? 1 : -1;
+	if (x->calls != y->calls)
+		return x->calls < y->calls ? 1 : -1;
+	return x->xt - y->xt;
+}
+
+
+int fth_getprofile(profile_entry_t *entries, int max)
+{
+	profile_entry_t e;
+	int xt, n = 0, filled = 0, i;
+	
+	for (xt = 1; xt < F.profilesize && xt < F.cp; xt++) {
+		if (!F.profile[xt].calls)
+			continue;
+		n++;
+		if (!entries || max <= 0)
+			continue;
+		
+		e.xt = xt;
+		e.primitive = F.code[xt] != ENTER && F.code[xt] != DODOES;
+		e.calls = F.profile[xt].calls;
+		e.inclusive = F.profile[xt].inclusive;
+		e.exclusive = F.profile[xt].exclusive;
+		// entries hold the hottest words seen so far in sorted order
+		if (filled == max && profilecmp(&e, &entries[max - 1]) >= 0)
+			continue;
+		e.name = xtname(xt);
+		if (filled < max)
+			filled++;
+		for (i = filled - 1; i > 0 && profilecmp(&e, &entries[i - 1]) < 0; i--)
+			entries[i] = entries[i - 1];
+		entries[i] = e;
+	}
+	
+	return entries ? filled : n;
+}
+#endif
+
+
+const char *fth_opname(int prim)
+{
+	int i;
+	
+	for (i = 0; core_words[i].name; i++)
+		if (core_words[i].code == prim)
+			return core_words[i].name;
+	
+	for (i = 0; runtime_words[i].name; i++)
+		if (runtime_words[i].code == prim)
+			return runtime_words[i].name;
+	
+	switch (prim) {
+		case ENTER:		return "(ENTER)";
+		case DOCONSTANT:	return "(CONSTANT)";
+		case DOVARIABLE:	return "(VARIABLE)";
+		case DODOES:		return "(DOES)";
+		case DOVALUE:		return "(VALUE)";
+		case DOVOCABULARY:	return "(VOCABULARY)";
+	}
+	
+	// application primitives, the code field of their words holds the opcode
+	for (i = F.dictp - 1; i > 0; i--)
+		if (F.code[F.dict[i].xt] == prim)
+			return &F.names[F.dict[i].name];
+	
+	return NULL;
+}
+
+
+#ifndef FORTH_NO_TRACER
+int fth_starttrace(int mask, int capacity)
+{
+	if (capacity <= 0)
+		capacity = F.tracecap ? F.tracecap : 65536;
+	if (capacity != F.tracecap) {
+		trace_event_t *trace = (trace_event_t *)realloc(F.trace, capacity * sizeof(trace_event_t));
+		
+		if (!trace)
+			return 0;
+		F.trace = trace;
+		F.tracecap = capacity;
+	}
+	F.tracecount = 0;
+	F.tracemask = mask;
+	return 1;
+}
+
+
+void fth_stoptrace(void)
+{
+	F.tracemask = 0;
+}
+
+
+static void jsonstring(FILE *f, const char *s)
+{
+	fputc('"', f);
+	for (; *s; s++) {
+		if (*s == '"' || *s == '\\')
+			fprintf(f, "\\%c", *s);
+		else if ((unsigned char)*s < ' ')
+			fprintf(f, "\\u%04x", *s);
+		else
+			fputc(*s, f);
+	}
+	fputc('"', f);
+}
+
+
+static const char *tracename(int xt, char *buf)
+{
+	const char *name;
+	
+	if (!xt)
+		return "<interpreter>";
+	name = xt > 0 && xt < F.cp ? xtname(xt) : NULL;
+	if (!name) {
+		sprintf(buf, "<xt %d>", xt);
+		name = buf;
+	}
+	return name;
+}
+
+
+// writes trace in Chrome trace event format, timestamps are monotonic clock microseconds
+void fth_savetrace(const char *fname, int pid, int tid)
+{
+	static const char *ionames[] = {"SAVE", "LOAD", "SAVE-PROGRAM", "SHAKE-PROGRAM", "RUN-PROGRAM", "SAVE-DATA", "LOAD-DATA"};
+	long long i = F.tracecount > F.tracecap ? F.tracecount - F.tracecap : 0;
+	int open = 0, n = 0;
+	FILE *f;
+	
+	f = fopen(fname, "w");
+	check(!f, "trace save error: %s", strerror(errno));
+	
+	fprintf(f, "{\"traceEvents\": [");
+	for (; i < F.tracecount; i++) {
+		trace_event_t *e = &F.trace[i % F.tracecap];
+		const char *name = NULL, *cat = NULL, *ph = NULL;
+		char buf[32];
+		
+		switch (e->type) {
+			case TE_ENTER:
+			case TE_EXIT:
+				name = tracename(e->arg, buf), cat = "word";
+				break;
+			case TE_PRIM:
+			case TE_PRIMEND:
+				name = fth_opname(e->arg), cat = "prim";
+				if (!name) {
+					sprintf(buf, "<%d>", e->arg);
+					name = buf;
+				}
+				break;
+			case TE_ERROR:
+				name = "error", cat = "error", ph = "i";
+				break;
+			case TE_CATCH:
+				name = "catch", cat = "error", ph = "i";
+				break;
+			case TE_GROW:
+				name = areanames[e->arg], cat = "memory", ph = "i";
+				break;
+			case TE_IO:
+			case TE_IOEND:
+				name = ionames[e->arg], cat = "io";
+				break;
+		}
+		if (!ph) {
+			// begin and end events; ends of frames opened before tracing or overwritten in the ring are dropped
+			if (e->type == TE_ENTER || e->type == TE_PRIM || e->type == TE_IO) {
+				ph = "B";
+				open++;
+			} else if (open > 0) {
+				ph = "E";
+				open--;
+			} else {
+				continue;
+			}
+		}
+		
+		fprintf(f, "%s\n\t{\"name\": ", n++ ? "," : "");
+		jsonstring(f, name);
+		fprintf(f, ", \"cat\": \"%s\", \"ph\": \"%s\", \"ts\": %lld.%03d, \"pid\": %d, \"tid\": %d",
+			cat, ph, e->ts / 1000, (int)(e->ts % 1000), pid, tid);
+		if (e->type == TE_ERROR || e->type == TE_CATCH) {
+			fprintf(f, ", \"s\": \"t\", \"args\": {\"word\": ");
+			jsonstring(f, tracename(e->arg, buf));
+			fprintf(f, "}");
+		} else if (e->type == TE_GROW) {
+			fprintf(f, ", \"s\": \"t\", \"args\": {\"size\": %d}", e->arg2);
+		}
+		fputc('}', f);
+	}
+	fprintf(f, "\n], \"displayTimeUnit\": \"ns\"}\n");
+	
+	check(ferror(f), "trace save error: %s", strerror(errno));
+	fclose(f);
+}
+#endif
+
+
+#ifdef FORTH_OPSTATS
+long long fth_getopcount(int prim)
+{
+	return F.opstats[opindex(prim)];
+}
+
+
+long long fth_getoppaircount(int prev, int prim)
+{
+	return F.opstats[NUM_OPSTATS + opindex(prev) * NUM_OPSTATS + opindex(prim)];
+}
+
+
+void fth_resetopstats(void)
+{
+	memset(F.opstats, 0, (NUM_OPSTATS + NUM_OPSTATS * NUM_OPSTATS) * sizeof(long long));
+	F.lastop = -1;
+}
+
+
+// writes name quoted for CSV (quote doubled) or JSON (quote and backslash escaped)
+static void dumpname(FILE *f, int idx, int json)
+{
+	const char *name = opcode(idx) < 0 ? "<other>" : fth_opname(opcode(idx));
+	char buf[16];
+	
+	if (!name) {
+		sprintf(buf, "<%d>", opcode(idx));
+		name = buf;
+	}
+	fputc('"', f);
+	for (; *name; name++) {
+		if (*name == '"')
+			fputc(json ? '\\' : '"', f);
+		else if (*name == '\\' && json)
+			fputc('\\', f);
+		fputc(*name, f);
+	}
+	fputc('"', f);
+}
+
+
+void fth_dumpopstats(const char *fname)
+{
+	int i, j, n = 0;
+	int json = strlen(fname) > 5 && strcasecmp(fname + strlen(fname) - 5, ".json") == 0;
+	long long count;
+	FILE *f;
+	
+	f = fopen(fname, "w");
+	check(!f, "opstats dump error: %s", strerror(errno));
+	
+	fprintf(f, json ? "{\"ops\": [" : "prev,op,code,count\n");
+	for (i = 0; i < NUM_OPSTATS; i++) {
+		if (!(count = F.opstats[i]))
+			continue;
+		if (json) {
+			fprintf(f, "%s\n\t{\"op\": ", n++ ? "," : "");
+			dumpname(f, i, 1);
+			fprintf(f, ", \"code\": %d, \"count\": %lld}", opcode(i), count);
+		} else {
+			fprintf(f, ",");
+			dumpname(f, i, 0);
+			fprintf(f, ",%d,%lld\n", opcode(i), count);
+		}
+	}
+	
+	if (json)
+		fprintf(f, "\n], \"pairs\": [");
+	n = 0;
+	for (i = 0; i < NUM_OPSTATS; i++)
+		for (j = 0; j < NUM_OPSTATS; j++) {
+			if (!(count = F.opstats[NUM_OPSTATS + i * NUM_OPSTATS + j]))
+				continue;
+			if (json) {
+				fprintf(f, "%s\n\t{\"prev\": ", n++ ? "," : "");
+				dumpname(f, i, 1);
+				fprintf(f, ", \"op\": ");
+				dumpname(f, j, 1);
+				fprintf(f, ", \"count\": %lld}", count);
+			} else {
+				dumpname(f, i, 0);
+				fprintf(f, ",");
+				dumpname(f, j, 0);
+				fprintf(f, ",,%lld\n", count);
+			}
+		}
+	if (json)
+		fprintf(f, "\n]}\n");
+	
+	check(ferror(f), "opstats dump error: %s", strerror(errno));
+	fclose(f);
+}
+#endif
+
+
+#ifdef FORTH_SAMPLER
+// SIGPROF handler: only copies integers from F into the preallocated ring buffer
+static void takesample(int sig)
+{
+	sample_t *s;
+	int rsp = F.rsp, i, n = 0;
+	
+	if (!F.samplecap)
+		return;
+	s = &F.samples[F.samplecount % F.samplecap];
+	if (rsp > RSTACK_SIZE)
+		rsp = RSTACK_SIZE;
+	for (i = 0; i < rsp; i++)
+		if (F.rstack[i].xt)
+			s->frames[n++] = F.rstack[i].xt;
+	if (F.running)
+		s->frames[n++] = F.running;
+	s->depth = n;
+	s->ip = F.ip;
+	F.samplecount++;
+}
+
+
+int fth_startsampling(int hz, int capacity)
+{
+	struct sigaction sa;
+	struct itimerval it;
+	
+	if (hz <= 0)
+		hz = 100;
+	if (capacity <= 0)
+		capacity = 60 * hz;		// a minute of samples
+	
+	fth_stopsampling();
+	if (capacity != F.samplecap) {
+		sample_t *samples = (sample_t *)realloc(F.samples, capacity * sizeof(sample_t));
+		
+		if (!samples)
+			return 0;
+		F.samples = samples;
+		F.samplecap = capacity;
+	}
+	F.samplecount = 0;
+	
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = takesample;
+	sa.sa_flags = SA_RESTART;
+	sigemptyset(&sa.sa_mask);
+	if (sigaction(SIGPROF, &sa, &oldprofaction) != 0)
+		return 0;
+	
+	it.it_interval.tv_sec = 0;
+	it.it_interval.tv_usec = hz > 1 ? 1000000 / hz : 999999;
+	it.it_value = it.it_interval;
+	if (setitimer(ITIMER_PROF, &it, NULL) != 0) {
+		sigaction(SIGPROF, &oldprofaction, NULL);
+		return 0;
+	}
+	sampling = 1;
+	return 1;
+}
+
+
+void fth_stopsampling(void)
+{
+	struct itimerval it;
+	
+	if (!sampling)
+		return;
+	memset(&it, 0, sizeof(it));
+	setitimer(ITIMER_PROF, &it, NULL);
+	sigaction(SIGPROF, &oldprofaction, NULL);
+	sampling = 0;
+}
+
+
+static int samplecmp(const void *a, const void *b)
+{
+	const sample_t *x = a, *y = b;
+	int i;
+	
+	for (i = 0; i < x->depth && i < y->depth; i++)
+		if (x->frames[i] != y->frames[i])
+			return x->frames[i] - y->frames[i];
+	return x->depth - y->depth;
+}
+
+
+static void savesampleframe(FILE *f, int xt)
+{
+	const char *name = xt > 0 && xt < F.cp ? xtname(xt) : NULL;
+	
+	if (!name) {
+		fprintf(f, "<xt %d>", xt);
+		return;
+	}
+	for (; *name; name++)
+		fputc(*name == ';' ? ':' : *name, f);	// ';' separates frames
+}
+
+
+// writes samples as folded stacks ("outer;inner;word count" lines) for flame graph tools
+void fth_savesamples(const char *fname)
+{
+	sigset_t mask, oldmask;
+	int n, i, j, count;
+	FILE *f;
+	
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGPROF);
+	sigprocmask(SIG_BLOCK, &mask, &oldmask);
+	
+	n = F.samplecount < F.samplecap ? F.samplecount : F.samplecap;
+	if (n > 0)
+		qsort(F.samples, n, sizeof(sample_t), samplecmp);
+	F.samplecount = 0;		// sorted samples are no longer a ring
+	
+	f = fopen(fname, "w");
+	if (f) {
+		for (i = 0; i < n; i += count) {
+			for (count = 1; i + count < n && samplecmp(&F.samples[i], &F.samples[i + count]) == 0; count++)
+				;
+			if (F.samples[i].depth == 0)
+				fprintf(f, "<interpreter>");
+			for (j = 0; j < F.samples[i].depth; j++) {
+				if (j > 0)
+					fputc(';', f);
+				savesampleframe(f, F.samples[i].frames[j]);
+			}
+			fprintf(f, " %d\n", count);
+		}
+		fclose(f);
+	}
+	
+	sigprocmask(SIG_SETMASK, &oldmask, NULL);
+	check(!f, "samples save error: %s", strerror(errno));
+}
+#endif
+
+
+#ifndef FORTH_NO_SAVES
+void fth_savesystem(const char *fname)
+{
+	char sig[4] = {SYSTEM_MARK, endian(), sizeof(int), FORMAT_VERSION};
+	FILE *f = fopen(fname, "wb");
+	
+	TRACE(FORTH_TRACE_IO, TE_IO, IO_SAVESYSTEM, 0);
+	check(!f, "save error: %s", strerror(errno));
+
+	check(fwrite(sig, 1, 4, f) < 4, "save error: %s", strerror(errno));
+	check(fwrite(&F.cp, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
+	check(fwrite(F.code, sizeof(int), F.cp, f) < F.cp, "save error: %s", strerror(errno));
+	check(fwrite(&F.dp, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
+	check(fwrite(F.data, 1, F.dp, f) < F.dp, "save error: %s", strerror(errno));
+	check(fwrite(&F.dictp, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
+	check(fwrite(F.dict, sizeof(word_t), F.dictp, f) < F.dictp, "save error: %s", strerror(errno));
+	check(fwrite(&F.namesp, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
+	check(fwrite(F.names, 1, F.namesp, f) < F.namesp, "save error: %s", strerror(errno));
+	check(fwrite(&F.forth_voc, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
+	
+	check(fwrite(&F.lit_xt, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
+	check(fwrite(&F.exit_xt, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
+	check(fwrite(&F.branch_xt, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
+	check(fwrite(&F.qbranch_xt, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
+	check(fwrite(&F.dodo_xt, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
+	check(fwrite(&F.doqdo_xt, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
+	check(fwrite(&F.doloop_xt, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
+	check(fwrite(&F.doaddloop_xt, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
+	check(fwrite(&F.codecomma_xt, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
+	check(fwrite(&F.store_xt, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
+	check(fwrite(&F.dotry_xt, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
+	check(fwrite(&F.litxt_xt, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
+	check(fwrite(&F.parloop_xt, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
+	
+	fclose(f);
+	TRACE(FORTH_TRACE_IO, TE_IOEND, IO_SAVESYSTEM, 0);
+}
+
+
+void fth_loadsystem(const char *fname)
+{
+	char sig[4];
+	FILE *f = fopen(fname, "rb");
+	
+	TRACE(FORTH_TRACE_IO, TE_IO, IO_LOADSYSTEM, 0);
+	check(!f, "load error: %s", strerror(errno));
+	
+	check(fread(sig, 1, 4, f) < 4, "load error: %s", strerror(errno));
+	check(sig[0] != SYSTEM_MARK, "load error: invalid system mark: %c", sig[0]);
+	check(sig[1] != endian(), "system is saved for different data endianness: %d (we have %d)", sig[1], endian());
+	check(sig[2] != sizeof(int), "system is saved for different cell size: %d (we have %d)", sig[2], sizeof(int));
+	check(sig[3] != FORMAT_VERSION, "system is saved in different format version: %d (we have %d)", sig[3], FORMAT_VERSION);
+#ifndef FORTH_NO_CHECKPOINTS
+	dropcheckpoint();		// everything is replaced
+#endif
+	
+	check(fread(&F.cp, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
+	check(!reserve((void **)&F.code, &F.codecap, F.cp * sizeof(int), 0), "unable to expand code area for loading system state");
+	check(fread(F.code, sizeof(int), F.cp, f) < F.cp, "load error: %s", strerror(errno));
+	check(fread(&F.dp, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
+	check(!reserve((void **)&F.data, &F.datacap, F.dp, 0), "unable to expand data area for loading system state");
+	check(fread(F.data, 1, F.dp, f) < F.dp, "load error: %s", strerror(errno));
+	check(fread(&F.dictp, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
+	check(!reserve((void **)&F.dict, &F.dictcap, F.dictp * sizeof(word_t), 0), "unable to expand dictionary area for loading system state");
+	check(fread(F.dict, sizeof(word_t), F.dictp, f) < F.dictp, "load error: %s", strerror(errno));
+	check(fread(&F.namesp, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
+	check(!reserve((void **)&F.names, &F.namescap, F.namesp, 0), "unable to expand names area for loading system state");
+	check(fread(F.names, 1, F.namesp, f) < F.namesp, "load error: %s", strerror(errno));
+	check(fread(&F.forth_voc, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
+	
+	check(fread(&F.lit_xt, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
+	check(fread(&F.exit_xt, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
+	check(fread(&F.branch_xt, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
+	check(fread(&F.qbranch_xt, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
+	check(fread(&F.dodo_xt, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
+	check(fread(&F.doqdo_xt, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
+	check(fread(&F.doloop_xt, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
+	check(fread(&F.doaddloop_xt, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
+	check(fread(&F.codecomma_xt, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
+	check(fread(&F.store_xt, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
+	check(fread(&F.dotry_xt, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
+	check(fread(&F.litxt_xt, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
+	check(fread(&F.parloop_xt, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
+	
+	fclose(f);
+	TRACE(FORTH_TRACE_IO, TE_IOEND, IO_LOADSYSTEM, 0);
+	reindex();
+	fth_reset();
+}
+
+
+void fth_saveprogram(const char *fname, const char *entry)
+{
+	word_t *w = find(entry);
+	
+	check(w == NULL, "%s ?", entry);
+	saveprogram(fname, w->xt);
+}
+
+
+int fth_shakeprogram(const char *fname, const char *entry)
+{
+	word_t *w = find(entry);
+	
+	check(w == NULL, "%s ?", entry);
+	return shakeprogram(fname, w->xt);
+}
+
+
+int fth_runprogram(const char *fname)
+{
+	char sig[4];
+	int entry;
+	FILE *f = fopen(fname, "rb");
+	jmp_buf oerr;
+	int ret;
+	
+	TRACE(FORTH_TRACE_IO, TE_IO, IO_RUNPROGRAM, 0);
+	check(!f, "load error: %s", strerror(errno));
+	
+	check(fread(sig, 1, 4, f) < 4, "load error: %s", strerror(errno));
+	check(sig[0] != PROGRAM_MARK, "load error: invalid program mark: %c", sig[0]);
+	check(sig[1] != endian(), "program is saved for different data endianness: %d (we have %d)", sig[1], endian());
+	check(sig[2] != sizeof(int), "program is saved for different cell size: %d (we have %d)", sig[2], sizeof(int));
+	check(sig[3] != FORMAT_VERSION, "program is saved in different format version: %d (we have %d)", sig[3], FORMAT_VERSION);
+#ifndef FORTH_NO_CHECKPOINTS
+	dropcheckpoint();
+#endif
+	
+	check(fread(&entry, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
+	check(fread(&F.cp, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
+	check(!reserve((void **)&F.code, &F.codecap, F.cp * sizeof(int), 0), "unable to expand code area for loading system state");
+	check(fread(F.code, sizeof(int), F.cp, f) < F.cp, "load error: %s", strerror(errno));
+	check(fread(&F.dp, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
+	check(!reserve((void **)&F.data, &F.datacap, F.dp, 0), "unable to expand data area for loading system state");
+	check(fread(F.data, 1, F.dp, f) < F.dp, "load error: %s", strerror(errno));
+	
+	check(fread(&F.lit_xt, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
+	check(fread(&F.exit_xt, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
+	check(fread(&F.branch_xt, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
+	check(fread(&F.qbranch_xt, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
+	check(fread(&F.dodo_xt, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
+	check(fread(&F.doqdo_xt, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
+	check(fread(&F.doloop_xt, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
+	check(fread(&F.doaddloop_xt, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
+	check(fread(&F.codecomma_xt, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
+	check(fread(&F.store_xt, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
+	check(fread(&F.dotry_xt, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
+	check(fread(&F.litxt_xt, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
+	check(fread(&F.parloop_xt, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
+	
+	fclose(f);
+	TRACE(FORTH_TRACE_IO, TE_IOEND, IO_RUNPROGRAM, 0);
+	reindex();
+	if (entry > 0 && entry < F.cp && !xtname(entry))
+		indexcode(entry, 0);
+	fth_reset();
+	
+	memcpy(oerr, F.errjmp, sizeof(jmp_buf));
+	F.errhandlers++;
+	if (setjmp(F.errjmp) == 0) {
+		checkcode(entry);
+		execute(entry);
+		ret = 1;
+	} else {
+		ret = 0;
+	}
+	memcpy(F.errjmp, oerr, sizeof(jmp_buf));
+	F.errhandlers--;
+	return ret;
+}
+
+
+void fth_savedata(const char *fname)
+{
+	char sig[4] = {DATA_MARK, endian(), sizeof(int), 0};
+	FILE *f;
+	
+	f = fopen(fname, "wb");
+	TRACE(FORTH_TRACE_IO, TE_IO, IO_SAVEDATA, 0);
+	check(!f, "save error: %s", strerror(errno));
+	
+	check(fwrite(sig, 1, 4, f) < 4, "save error: %s", strerror(errno));
+	check(fwrite(&F.dp, sizeof(int), 1, f) == 0, "save error: %s", strerror(errno));
+	check(fwrite(F.data, 1, F.dp, f) < F.dp, "save error: %s", strerror(errno));
+	
+	fclose(f);
+	TRACE(FORTH_TRACE_IO, TE_IOEND, IO_SAVEDATA, 0);
+}
+
+
+void fth_loaddata(const char *fname)
+{
+	char sig[4];
+	FILE *f = fopen(fname, "rb");
+	
+	TRACE(FORTH_TRACE_IO, TE_IO, IO_LOADDATA, 0);
+	check(!f, "load error: %s", strerror(errno));
+#ifndef FORTH_NO_CHECKPOINTS
+	if (F.dirtymap)
+		dirty(0, F.ckdp);
+#endif
+	
+	check(fread(sig, 1, 4, f) < 4, "load error: %s", strerror(errno));
+	check(sig[0] != DATA_MARK, "load error: invalid data mark: %c", sig[0]);
+	check(sig[1] != endian(), "program is saved for different data endianness: %d (we have %d)", sig[1], endian());
+	check(sig[2] != sizeof(int), "program is saved for different cell size: %d (we have %d)", sig[2], sizeof(int));
+	check(sig[3] != 0, "signature reserved byte is non-zero");
+	
+	check(fread(&F.dp, sizeof(int), 1, f) == 0, "load error: %s", strerror(errno));
+	check(!reserve((void **)&F.data, &F.datacap, F.dp, 0), "unable to expand data area for loading data");
+	check(fread(F.data, 1, F.dp, f) < F.dp, "load error: %s", strerror(errno));
+	
+	fclose(f);
+	TRACE(FORTH_TRACE_IO, TE_IOEND, IO_LOADDATA, 0);
+}
+#endif
+
+
+// Image writer of the build (mkimage), also available without saves
+void fth_saveimage(const char *fname, const char *name)
+{
+	FILE *f = fopen(fname, "w");
+	int i;
+	
+	check(!f, "save error: %s", strerror(errno));
+	
+	fprintf(f, "// Forth system image generated by fth_saveimage()\n\n");
+	
+	fprintf(f, "static const int %s_code[] = {", name);
+	for (i = 0; i < F.cp; i++)
+		fprintf(f, "%s%d,", i % 16 ? " " : "\n\t", F.code[i]);
+	fprintf(f, "\n};\n\n");
+	
+	fprintf(f, "static const char %s_data[] = {", name);
+	for (i = 0; i < F.dp; i++)
+		fprintf(f, "%s%d,", i % 16 ? " " : "\n\t", i ? F.data[i] : 0);
+	fprintf(f, "\n};\n\n");
+	
+	fprintf(f, "static const word_t %s_dict[] = {", name);
+	for (i = 0; i < F.dictp; i++)
+		if (i)
+			fprintf(f, "\n\t{%d, %d, %d, %d},", F.dict[i].link, F.dict[i].xt, F.dict[i].name, F.dict[i].flags);
+		else
+			fprintf(f, "\n\t{0, 0, 0, 0},");
+	fprintf(f, "\n};\n\n");
+	
+	fprintf(f, "static const char %s_names[] = {", name);
+	for (i = 0; i < F.namesp; i++)
+		fprintf(f, "%s%d,", i % 16 ? " " : "\n\t", F.names[i]);
+	fprintf(f, "\n};\n\n");
+	
+	fprintf(f, "static const forth_image_t %s = {\n", name);
+	fprintf(f, "\t%s_code, %d,\n", name, F.cp);
+	fprintf(f, "\t%s_data, %d,\n", name, F.dp);
+	fprintf(f, "\t%s_dict, %d,\n", name, F.dictp);
+	fprintf(f, "\t%s_names, %d,\n", name, F.namesp);
+	fprintf(f, "\t%d,\n", F.forth_voc);
+	fprintf(f, "\t%d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d\n", F.lit_xt, F.exit_xt, F.branch_xt, F.qbranch_xt, F.dodo_xt, F.doqdo_xt, F.doloop_xt, F.doaddloop_xt, F.codecomma_xt, F.store_xt, F.dotry_xt, F.litxt_xt, F.parloop_xt);
+	fprintf(f, "};\n");
+	
+	check(ferror(f), "save error: %s", strerror(errno));
+	fclose(f);
+}
+
+
+
+
+
+
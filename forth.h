@@ -1,180 +1,568 @@
-#ifndef _FORTH_H_
-#define _FORTH_H_
-
-#ifdef __cplusplus
-extern "C" {
-#endif
-
-// Settings
-// Uncomment to disable Forth system saving and loading capabilities via stdio
-// #define FORTH_NO_SAVES	1
-// Uncomment to enable workaround for alignment issues while accessing data area
-// #define FORTH_ALIGNMENT_HACK	1
-
-#define STACK_SIZE		32
-#define RSTACK_SIZE		32
-#define LSTACK_SIZE		16
-#define CFSTACK_SIZE		16
-#define CODE_INITIAL_SIZE	256		// cells
-#define DATA_INITIAL_SIZE	1024		// bytes
-#define DICT_INITIAL_SIZE	256		// words
-#define NAMES_INITIAL_SIZE	1024		// bytes
-#define WORD_MAX	32			// bytes
-
-
-// Includes
-#include <setjmp.h>
-
-
-// Macros
-#define CORE_PRIM_FIRST		1000
-#define ERROR_MAX		256
-#define FORTH_BOOL(x)		((x) ? ~0 : 0)
-
-
-// Types
-typedef struct primitive_word {
-	const char *name;
-	int code;
-	int immediate;
-} primitive_word_t;
-
-typedef struct word {
-	int link;
-	int xt;
-	int name;
-	char flags;
-} word_t;
-
-enum cftype {
-	CFIF,
-	CFELSE,
-	CFTHEN,
-	CFBEGIN,
-	CFWHILE,
-	CFDO,
-	CFLOOP
-};
-
-typedef void (*primitives_f)(int prim);
-typedef int (*notfound_f)(const char *word);
-
-typedef struct forth {
-	// data stack
-	int stack[STACK_SIZE];
-	int sp;
-
-	// return stack
-	struct {
-		int ip;
-		int xt;
-	} rstack[RSTACK_SIZE];
-	int rsp;
-
-	// loop stack
-	struct {
-		int index, limit;
-		int leave;
-		int xt;
-	} lstack[LSTACK_SIZE];
-	int lsp;
-
-	// control flow stack
-	struct {
-		enum cftype type;
-		int ref;
-	} cfstack[CFSTACK_SIZE];
-	int cfsp;
-
-	// error handling
-	char errormsg[ERROR_MAX];
-	jmp_buf errjmp;
-	int errhandlers;
-
-	// app-specific primitives handler
-	primitives_f app_prims;
-	// app-specific word parsing
-	notfound_f app_notfound;
-
-	// code area
-	int *code;
-	int cp, codecap;
-
-	// data area
-	char *data;
-	int dp, datacap;
-
-	// dictionary area
-	word_t *dict;
-	int dictp, dictcap;
-	int context, current, forth_voc;
-
-	// names area
-	char *names;
-	int namesp, namescap;
-
-	// state
-	int ip;
-	int running;
-	int state;
-	const char *source;
-	int intp;
-	char word[WORD_MAX];
-
-	// core xt
-	int lit_xt, exit_xt, branch_xt, qbranch_xt, dodo_xt, doqdo_xt, doloop_xt, doaddloop_xt, codecomma_xt, store_xt, dotry_xt;
-} forth_t;
-
-
-// Data
-extern forth_t forth;
-
-
-// API
-
-void fth_error(const char *fmt, ...);
-void fth_push(int x);
-int fth_pop(void);
-int fth_fetch(int a);
-void fth_store(int a, int x);
-char fth_cfetch(int a);
-void fth_cstore(int a, char x);
-char *fth_area(int a, int size);
-
-void fth_init(primitives_f app_primitives, notfound_f app_notfnd);
-void fth_free(void);
-int fth_interpret(const char *s);
-int fth_execute(const char *w);
-void fth_primitive(const char *name, int code, int immediate);
-void fth_library(primitive_word_t *lib);
-
-void fth_reset(void);
-const char *fth_geterror(void);
-int fth_getdepth(void);
-int fth_getstack(int idx);
-int fth_getstate(void);
-const char *fth_geterrorline(int *plen, int *pintp, int *plineno);
-int fth_gettracedepth(void);
-const char *fth_gettrace(int idx);
-
-#ifndef FORTH_NO_SAVES
-void fth_savesystem(const char *fname);
-void fth_loadsystem(const char *fname);
-
-void fth_saveprogram(const char *fname, const char *entry);
-
-int fth_runprogram(const char *fname);
-
-void fth_savedata(const char *fname);
-void fth_loaddata(const char *fname);
-#endif
-
-
-#ifdef __cplusplus
-}
-#endif
-
-
-#endif
-
-
+#ifndef _FORTH_H_
+#define _FORTH_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Settings
+// Uncomment to disable Forth system saving and loading capabilities via stdio
+// #define FORTH_NO_SAVES	1
+// Uncomment to enable workaround for alignment issues while accessing data area
+// #define FORTH_ALIGNMENT_HACK	1
+// Uncomment to initialize core dictionary from core_image.h, generated by fth_saveimage() at build time
+// #define FORTH_STATIC_CORE	1
+// Uncomment to disable per-word profiler (PROFILE-ON, PROFILE-OFF, fth_getprofile())
+// #define FORTH_NO_PROFILER	1
+// Uncomment to count dispatched opcodes and opcode pairs (DUMP-OPSTATS, fth_dumpopstats())
+// #define FORTH_OPSTATS	1
+// Uncomment to enable SIGPROF sampling profiler (POSIX only; SAMPLE-ON, SAMPLE-OFF, SAVE-SAMPLES)
+// #define FORTH_SAMPLER	1
+// Uncomment to disable event tracer (TRACE-ON, TRACE-OFF, SAVE-TRACE, fth_starttrace())
+// #define FORTH_NO_TRACER	1
+// Uncomment to disable buffered output (TYPE, FLUSH, <# # #S #>, fth_type())
+// #define FORTH_NO_OUTPUT	1
+// Uncomment to disable cooperative multitasking (TASK, ACTIVATE, PAUSE, STOP, fth_pause())
+// #define FORTH_NO_TASKS	1
+// Uncomment to disable atomic memory words for compilers without GCC __atomic builtins (ATOMIC@, CAS, FENCE)
+// #define FORTH_NO_ATOMICS	1
+// Uncomment to disable channels between tasks and threads (CHANNEL, SEND, RECV, fth_newchannel()), needs atomics
+// #define FORTH_NO_CHANNELS	1
+// Uncomment to disable instance cloning with copy-on-write sharing of code and dictionary (fth_clone())
+// #define FORTH_NO_CLONES	1
+// Uncomment to disable checkpoints with dirty tracking of the data area (fth_checkpoint(), fth_restore())
+// #define FORTH_NO_CHECKPOINTS	1
+// Uncomment to disable execution budgets and deadlines (SET-BUDGET, FUEL, fth_setbudget())
+// #define FORTH_NO_BUDGET	1
+// Uncomment to disable resumable executions suspended by YIELD or a step limit (fth_start(), fth_resume())
+// #define FORTH_NO_RESUMABLE	1
+// Uncomment to enable epoll event loop with non-blocking socket and pipe words (Linux only; RUN-EVENTS, fth_pollevents())
+// #define FORTH_REACTOR	1
+// Uncomment to enable parallel loops on worker threads (POSIX threads, build with -pthread; PAR-DO, PAR-FOR)
+// #define FORTH_THREADS	1
+
+#define STACK_SIZE		32
+#define RSTACK_SIZE		32
+#define LSTACK_SIZE		16
+#define CFSTACK_SIZE		16
+#define CODE_INITIAL_SIZE	256		// cells
+#define DATA_INITIAL_SIZE	1024		// bytes
+#define DICT_INITIAL_SIZE	256		// words
+#define NAMES_INITIAL_SIZE	1024		// bytes
+#define MAPS_MAX		16		// external memory regions
+#define WORD_MAX	32			// bytes
+#define OPSTATS_APP_MAX		128		// application opcodes counted separately
+#define OUTPUT_BUFFER_SIZE	8192		// bytes
+#define HOLD_SIZE		64		// bytes of pictured numeric output
+#define WORKERS_MAX		64		// parallel loop worker threads
+#define CHANNELS_MAX		256		// channels of the process
+#define DIRTY_BLOCK		256		// bytes of data area restored together after a checkpoint
+#define FUEL_CHUNK		4096		// budget steps between deadline checks
+
+
+// Includes
+#include <setjmp.h>
+
+
+// Macros
+#define CORE_PRIM_FIRST		1000
+#define MAP_FIRST		0x40000000	// data address of the first external memory region
+#define MAP_SPAN		0x02000000	// address space reserved for each region
+#define ERROR_MAX		256
+#define FORTH_BOOL(x)		((x) ? ~0 : 0)
+
+// event tracer categories
+#define FORTH_TRACE_WORDS	1		// entries and exits of colon and DOES> words
+#define FORTH_TRACE_PRIMS	2		// application primitive calls
+#define FORTH_TRACE_ERRORS	4		// errors and TRY catches
+#define FORTH_TRACE_MEMORY	8		// area growth
+#define FORTH_TRACE_IO		16		// saves and loads
+#define FORTH_TRACE_ALL		31
+
+// output flush policies, see fth_setoutput()
+#define FORTH_FLUSH_FULL	0		// only when the buffer is full or on FLUSH
+#define FORTH_FLUSH_LINE	1		// also after every newline
+
+// fth_resume() results
+#define FORTH_DONE		0		// the execution has finished, its stack holds the results
+#define FORTH_YIELDED		1		// suspended by YIELD or the step limit, can be resumed
+#define FORTH_ERROR		-1		// failed, see fth_geterror()
+
+
+// Types
+typedef struct primitive_word {
+	const char *name;
+	int code;
+	int immediate;
+} primitive_word_t;
+
+typedef struct word {
+	int link;
+	int xt;
+	int name;
+	char flags;
+} word_t;
+
+typedef struct rstack_entry {
+	int ip;
+	int xt;
+} rstack_entry_t;
+
+typedef struct lstack_entry {
+	int index, limit;
+	int leave;
+	int xt;
+} lstack_entry_t;
+
+typedef struct codeindex {
+	int xt;
+	int word;		// dictionary index, 0 for { } blocks and core xt-s
+} codeindex_t;
+
+typedef struct patch_entry {
+	int a;			// code address or minus dictionary index
+	int x;			// code cell or word flags before the change
+} patch_entry_t;
+
+enum cftype {
+	CFIF,
+	CFELSE,
+	CFTHEN,
+	CFBEGIN,
+	CFWHILE,
+	CFDO,
+	CFLOOP,
+	CFPARDO,
+	CFPARLOOP
+};
+
+typedef struct forth_image {
+	const int *code;
+	int cp;
+	const char *data;
+	int dp;
+	const word_t *dict;
+	int dictp;
+	const char *names;
+	int namesp;
+	int forth_voc;
+	int lit_xt, exit_xt, branch_xt, qbranch_xt, dodo_xt, doqdo_xt, doloop_xt, doaddloop_xt, codecomma_xt, store_xt, dotry_xt, litxt_xt, parloop_xt;
+} forth_image_t;
+
+typedef void (*primitives_f)(int prim);
+typedef void (*primfunc_f)(void *udata);
+typedef int (*notfound_f)(const char *word);
+typedef void (*output_f)(const char *s, int len, void *udata);
+
+typedef struct primitive_func {
+	const char *name;
+	int code;
+	primfunc_f func;
+	void *udata;
+	int immediate;
+} primitive_func_t;
+
+typedef struct app_func {
+	primfunc_f func;
+	void *udata;
+} app_func_t;
+
+typedef struct profile_counter {
+	long long calls;
+	long long inclusive, exclusive;		// nanoseconds
+	int active;				// frames of the word on the return stack
+} profile_counter_t;
+
+typedef struct profile_entry {
+	int xt;
+	const char *name;
+	int primitive;				// no timings are collected for primitives
+	long long calls;
+	long long inclusive, exclusive;		// nanoseconds
+} profile_entry_t;
+
+typedef struct sample {
+	int ip;
+	int depth;
+	int frames[RSTACK_SIZE + 1];		// xt-s from the outermost call to F.running
+} sample_t;
+
+typedef struct forth_stats {
+	// stacks: current depth, peak depth and size in elements
+	int sp, sppeak, stacksize;
+	int rsp, rsppeak, rstacksize;
+	int lsp, lsppeak, lstacksize;
+	int cfsp, cfsppeak, cfstacksize;
+	// areas: current pointer, peak pointer and capacity; code in cells, dictionary in words, data and names in bytes
+	int cp, cppeak, codecap;
+	int dp, dppeak, datacap;
+	int dictp, dictppeak, dictcap;
+	int namesp, namesppeak, namescap;
+	// area reallocations and bytes moved by them
+	long long reallocs, copied;
+	// errors raised and errors caught by TRY
+	long long errors, caught;
+} forth_stats_t;
+
+typedef struct task {
+	// saved execution state of a suspended task
+	int stack[STACK_SIZE];
+	int sp;
+	rstack_entry_t rstack[RSTACK_SIZE];
+	int rsp;
+	lstack_entry_t lstack[LSTACK_SIZE];
+	int lsp;
+	int ip, running;
+	// ring of active tasks, both are -1 for a stopped task
+	int next, prev;
+} task_t;
+
+typedef struct resumable {
+	task_t state;				// saved execution state, the ring fields are unused
+	int xt;					// word to execute on the first fth_resume(), then 0
+	int status;				// FORTH_YIELDED until the execution ends
+	int nextfree;				// list of free handles
+} resumable_t;
+
+typedef struct reactor_watch {
+	int readxt, writext;			// callbacks ( fd -- ), 0 if not watched
+} reactor_watch_t;
+
+typedef struct reactor_timer {
+	long long due;				// fth_nanotime() of the next run
+	int period;				// milliseconds, 0 for one-shot timers
+	int xt;					// callback ( id -- )
+	int id;
+} reactor_timer_t;
+
+typedef struct trace_event {
+	long long ts;				// nanoseconds
+	int type;
+	int arg, arg2;
+} trace_event_t;
+
+typedef struct forth {
+	// data stack
+	int stack[STACK_SIZE];
+	int sp;
+
+	// return stack
+	rstack_entry_t rstack[RSTACK_SIZE];
+	int rsp;
+
+	// loop stack
+	lstack_entry_t lstack[LSTACK_SIZE];
+	int lsp;
+
+	// control flow stack
+	struct {
+		enum cftype type;
+		int ref;
+	} cfstack[CFSTACK_SIZE];
+	int cfsp;
+
+	// error handling
+	char errormsg[ERROR_MAX];
+	jmp_buf errjmp;
+	int errhandlers;
+
+	// app-specific primitives handler
+	primitives_f app_prims;
+	// app-specific primitives bound to C functions, indexed by opcode
+	app_func_t *app_funcs;
+	// app-specific word parsing
+	notfound_f app_notfound;
+
+	// code area
+	int *code;
+	int cp, codecap;
+
+	// data area
+	char *data;
+	int dp, datacap;
+	
+	// external memory regions mapped into data area address space
+	struct {
+		char *ptr;
+		int size;
+		int readonly;
+	} maps[MAPS_MAX];
+
+	// dictionary area
+	word_t *dict;
+	int dictp, dictcap;
+	int context, current, forth_voc;
+
+	// names area
+	char *names;
+	int namesp, namescap;
+	
+	// starts of definitions and { } blocks sorted by code address
+	codeindex_t *codeindex;
+	int codeindexp, codeindexcap;
+	
+#ifndef FORTH_NO_CLONES
+	// reference counters of areas shared copy-on-write with clones, NULL for private areas
+	int *coderefs, *dictrefs, *namesrefs, *codeindexrefs;
+#endif
+
+#ifndef FORTH_NO_CHECKPOINTS
+	// checkpoint: saved pointers, copy of the data area, its blocks written since and changed compiled cells
+	int ckcp, ckdp, ckdictp, cknamesp, ckcodeindexp, ckcontext, ckcurrent, cktaskp;
+	int ckprofiling, cktracemask, cksampling;
+	unsigned ckserial;			// marks channels created since the checkpoint
+	char *ckdata;
+	unsigned char *dirtymap;		// per DIRTY_BLOCK bytes below ckdp, NULL without checkpoint
+	int *dirtyblocks, ndirty;
+	patch_entry_t *patches;
+	int patchp, patchescap;
+#endif
+
+	// usage statistics, see fth_getstats()
+	forth_stats_t stats;
+	
+#ifndef FORTH_NO_BUDGET
+	// execution budget: steps until the next refuel(), steps left beyond them (-1 - unlimited),
+	// deadline in fth_nanotime() units (0 - none)
+	int fuel;
+	long long budget, deadline;
+#endif
+
+	// state
+	int ip;
+	int running;
+	int state;
+#ifdef FORTH_THREADS
+	int worker;			// number of the part + 1 in parallel loop worker threads, 0 otherwise
+#endif
+	const char *source;
+	int intp;
+	char word[WORD_MAX];
+
+#ifndef FORTH_NO_PROFILER
+	// profiler
+	int profiling;
+	profile_counter_t *profile;		// indexed by xt
+	int profilesize;			// entries
+	struct {
+		int xt;
+		long long start, children;
+	} pstack[RSTACK_SIZE + 1];		// indexed by return stack depth
+	int psp;
+#endif
+	
+#ifdef FORTH_OPSTATS
+	// opcode counters followed by opcode pair counters, see opindex()
+	long long *opstats;
+	int lastop;
+#endif
+	
+#ifndef FORTH_NO_TRACER
+	// event tracer ring buffer
+	int tracemask;
+	trace_event_t *trace;
+	int tracecap;
+	long long tracecount;
+#endif
+	
+#ifndef FORTH_NO_OUTPUT
+	// output buffer, passed to the sink when full, see fth_setoutput()
+	char out[OUTPUT_BUFFER_SIZE];
+	int outp;
+	int outmode;
+	output_f output;
+	void *outudata;
+	// pictured numeric output, filled from the end
+	char hold[HOLD_SIZE];
+	int holdp;
+#endif
+	
+#ifndef FORTH_NO_TASKS
+	// tasks sharing code and data areas, task 0 is the one started by the host
+	task_t *tasks;
+	int taskp, taskscap;
+	int task;				// current task
+#endif
+	
+#ifndef FORTH_NO_RESUMABLE
+	// resumable executions, handle 0 is unused and heads the list of free handles
+	resumable_t *resumables;
+	int resumablep, resumablescap;
+	// handle being resumed (0 - none), level of error handlers at which it can be suspended
+	// and whether running out of the budget suspends it instead of raising an error
+	int resuming, resumelevel, stepyield;
+#endif
+	
+#ifdef FORTH_REACTOR
+	// event loop: epoll descriptor, callbacks indexed by file descriptor and timers
+	int epollfd;
+	reactor_watch_t *watches;
+	int watchescap, nwatches;
+	reactor_timer_t *timers;
+	int timerp, timerscap;
+	int lasttimer;
+	int stopevents;
+#endif
+	
+#ifdef FORTH_SAMPLER
+	// sampling profiler ring buffer, filled by SIGPROF handler
+	sample_t *samples;
+	int samplecap;
+	volatile unsigned samplecount;
+#endif
+	
+	// core xt
+	int lit_xt, exit_xt, branch_xt, qbranch_xt, dodo_xt, doqdo_xt, doloop_xt, doaddloop_xt, codecomma_xt, store_xt, dotry_xt, litxt_xt, parloop_xt;
+} forth_t;
+
+
+// Data
+#ifdef FORTH_THREADS
+// every thread has its own interpreter state, parallel loop workers share the areas of the caller
+extern __thread forth_t forth;
+#else
+extern forth_t forth;
+#endif
+
+
+// API
+
+void fth_error(const char *fmt, ...);
+void fth_push(int x);
+int fth_pop(void);
+int fth_fetch(int a);
+void fth_store(int a, int x);
+char fth_cfetch(int a);
+void fth_cstore(int a, char x);
+char *fth_area(int a, int size);
+int fth_length(int a);
+long long fth_nanotime(void);
+int fth_map(void *ptr, int size, int readonly);
+void fth_unmap(int a);
+
+void fth_init(primitives_f app_primitives, notfound_f app_notfnd);
+void fth_initimage(const forth_image_t *img, primitives_f app_primitives, notfound_f app_notfnd);
+void fth_free(void);
+#ifndef FORTH_NO_CLONES
+int fth_clone(forth_t *parent);
+#endif
+#ifndef FORTH_NO_BUDGET
+void fth_setbudget(long long steps, int ms);
+long long fth_getfuel(void);
+#endif
+
+#ifndef FORTH_NO_CHECKPOINTS
+int fth_checkpoint(void);
+int fth_restore(void);
+#endif
+int fth_interpret(const char *s);
+int fth_execute(const char *w);
+int fth_lookup(const char *w);
+int fth_call(int xt, const int *args, int nargs, int *results, int nresults);
+int fth_callbatch(int xt, const int *args, int nargs, int *results, int nresults, int count);
+void fth_primitive(const char *name, int code, int immediate);
+void fth_library(primitive_word_t *lib);
+void fth_bindprimitive(int code, primfunc_f func, void *udata);
+void fth_primitivefunc(const char *name, int code, primfunc_f func, void *udata, int immediate);
+void fth_libraryfunc(primitive_func_t *lib);
+void fth_bindlibrary(primitive_func_t *lib);
+
+void fth_reset(void);
+const char *fth_geterror(void);
+int fth_getdepth(void);
+int fth_getstack(int idx);
+int fth_getstate(void);
+const char *fth_geterrorline(int *plen, int *pintp, int *plineno);
+void fth_getstats(forth_stats_t *st);
+void fth_resetstats(void);
+int fth_gettracedepth(void);
+const char *fth_gettrace(int idx);
+const char *fth_codename(int a, int *pstart);
+
+#ifndef FORTH_NO_OUTPUT
+void fth_setoutput(output_f sink, void *udata, int mode);
+void fth_emit(char c);
+void fth_type(const char *s, int len);
+void fth_typenumber(int x, int base);
+void fth_flush(void);
+#endif
+
+#ifndef FORTH_NO_TASKS
+void fth_pause(void);
+#endif
+
+#ifndef FORTH_NO_RESUMABLE
+int fth_start(int xt, const int *args, int nargs);
+int fth_resume(int handle, long long maxsteps);
+int fth_results(int handle, int *results, int nresults);
+void fth_discard(int handle);
+#endif
+
+#ifdef FORTH_THREADS
+void fth_setworkers(int n);
+#endif
+
+#ifndef FORTH_NO_CHANNELS
+int fth_newchannel(int capacity, int spsc);
+int fth_trysend(int ch, int x, int y);
+int fth_tryrecv(int ch, int *px, int *py);
+void fth_closechannel(int ch);
+void fth_freechannel(int ch);
+#endif
+
+#ifndef FORTH_NO_PROFILER
+void fth_setprofiling(int on);
+void fth_resetprofile(void);
+int fth_getprofile(profile_entry_t *entries, int max);
+#endif
+
+const char *fth_opname(int prim);
+
+#ifndef FORTH_NO_TRACER
+int fth_starttrace(int mask, int capacity);
+void fth_stoptrace(void);
+void fth_savetrace(const char *fname, int pid, int tid);
+#endif
+
+#ifdef FORTH_OPSTATS
+long long fth_getopcount(int prim);
+long long fth_getoppaircount(int prev, int prim);
+void fth_resetopstats(void);
+void fth_dumpopstats(const char *fname);
+#endif
+
+#ifdef FORTH_REACTOR
+int fth_pollevents(int timeout);
+void fth_stopevents(void);
+#endif
+
+#ifdef FORTH_SAMPLER
+int fth_startsampling(int hz, int capacity);
+void fth_stopsampling(void);
+void fth_savesamples(const char *fname);
+#endif
+
+#ifndef FORTH_NO_SAVES
+void fth_savesystem(const char *fname);
+void fth_loadsystem(const char *fname);
+
+void fth_saveprogram(const char *fname, const char *entry);
+int fth_shakeprogram(const char *fname, const char *entry);
+
+int fth_runprogram(const char *fname);
+
+void fth_savedata(const char *fname);
+void fth_loaddata(const char *fname);
+#endif
+
+void fth_saveimage(const char *fname, const char *name);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif
+
+
@@ -1,177 +1,777 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <errno.h>
-#include <time.h>
-#include <sys/stat.h>
-
-#include "forth.h"
-
-
-enum app_codes {
-	BYE,
-	DOT,
-	DOTX,
-	EMIT,
-	PRINT,
-	CR,
-	CLOCK,
-	DOTQUOTE,
-	
-	APP_PRIM_MAX
-};
-
-
-void app_primitives(int prim)
-{
-	switch (prim) {
-		case BYE:
-			exit(EXIT_SUCCESS);
-			break;
-		case DOT:
-			printf("%d ", fth_pop());
-			break;
-		case DOTX:
-			printf("%X ", fth_pop());
-			break;
-		case EMIT:
-			putchar(fth_pop());
-			break;
-		case PRINT:
-			printf("%s", fth_area(fth_pop(), 1));
-			break;
-		case CR:
-			putchar('\n');
-			break;
-		case CLOCK:
-			fth_push(clock());
-			break;
-		case DOTQUOTE:
-			fth_execute("\"");
-			fth_interpret("PRINT");
-			break;
-		
-		default:
-			fth_error("invalid opcode: %d", prim);
-			break;
-	}
-}
-
-
-primitive_word_t app_words[] = {
-	{"BYE",			BYE,		0},
-	{".",			DOT,		0},
-	{".X",			DOTX,		0},
-	{"EMIT",		EMIT,		0},
-	{"PRINT",		PRINT,		0},
-	{"CR",			CR,		0},
-	{"CLOCK",		CLOCK,		0},
-	{".\"",			DOTQUOTE,	1},
-		
-	{NULL,			0,		0}
-};
-
-
-int main(int argc, char *argv[])
-{
-	char tib[256];
-	
-	fth_init(app_primitives, NULL);
-	fth_library(app_words);
-	
-	if (argc > 1) {
-		FILE *f;
-		struct stat st;
-		char *source;
-		int read;
-		
-		if (stat(argv[1], &st) != 0) {
-			perror(argv[1]);
-			return 1;
-		}
-		
-		source = (char *)malloc(st.st_size + 1);
-		if (!source) {
-			perror("Unable to allocate memory for file contents");
-			return 1;
-		}
-		
-		f = fopen(argv[1], "r");
-		if (!f) {
-			perror(argv[1]);
-			free(source);
-			return 1;
-		}
-		
-		read = fread(source, 1, st.st_size, f);
-		fclose(f);
-		source[read] = 0;
-		
-		if (fth_interpret(source)) {
-			free(source);
-			return 0;
-		} else {
-			int lineno, linelen, intp, i;
-			const char *errline;
-			
-			fprintf(stderr, "Error: %s\n", fth_geterror());
-			errline = fth_geterrorline(&linelen, &intp, &lineno);
-			fprintf(stderr, "%s:%d\n", argv[1], lineno);
-			fprintf(stderr, "%.*s\n", linelen, errline);
-			fprintf(stderr, "%*s\n", intp + 1, "^");
-			
-			if (fth_gettracedepth() > 0) {
-				fprintf(stderr, "Traceback:\n");
-				for (i = fth_gettracedepth() - 1; i >= 0; i--) {
-					fprintf(stderr, "\t%s\n", fth_gettrace(i));
-				}
-			}
-			
-			fprintf(stderr, "Stack: ");
-			for (i = 0; i < fth_getdepth(); i++)
-				fprintf(stderr, "%d ", fth_getstack(i));
-			if (i == 0)
-				fprintf(stderr, "empty");
-			fprintf(stderr, "\n");
-			
-			fth_reset();
-			free(source);
-		}
-	}
-	
-	while (fgets(tib, 256, stdin))
-		if (strlen(tib) > 1) {
-			if (fth_interpret(tib)) {
-				if (!fth_getstate())
-					printf(" OK\n");
-			} else {
-				int lineno, linelen, intp, i;
-				const char *errline;
-				
-				fprintf(stderr, "Error: %s\n", fth_geterror());
-				errline = fth_geterrorline(&linelen, &intp, &lineno);
-				fprintf(stderr, "<stdin>:%d\n", lineno);
-				fprintf(stderr, "%.*s\n", linelen, errline);
-				fprintf(stderr, "%*s\n", intp + 1, "^");
-				
-				if (fth_gettracedepth() > 0) {
-					fprintf(stderr, "Traceback:\n");
-					for (i = fth_gettracedepth() - 1; i >= 0; i--) {
-						fprintf(stderr, "\t%s\n", fth_gettrace(i));
-					}
-				}
-				
-				fprintf(stderr, "Stack: ");
-				for (i = 0; i < fth_getdepth(); i++)
-					fprintf(stderr, "%d ", fth_getstack(i));
-				if (i == 0)
-					fprintf(stderr, "empty");
-				fprintf(stderr, "\n");
-				
-				fth_reset();
-			}
-		}
-	
-	return 0;
-}
-
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "forth.h"
+
+// daemon mode serving scripts over a Unix socket (-s), POSIX only
+#if !defined(_WIN32) && !defined(FORTH_NO_OUTPUT) && !defined(FORTH_NO_CHECKPOINTS) && !defined(FORTH_MKIMAGE)
+#  define SERVER	1
+#  include <unistd.h>
+#  include <signal.h>
+#  include <sys/socket.h>
+#  include <sys/un.h>
+#  include <sys/wait.h>
+
+#  define WORKERS_DEFAULT	4
+#  define REQUEST_MAX		(16 * 1024 * 1024)
+
+typedef struct buffer {
+	char *s;
+	int len, cap;
+} buffer_t;
+
+typedef struct reader {
+	int fd, pos, len;
+	char buf[4096];
+} reader_t;
+
+static int serving, byerequested;
+#  ifndef FORTH_NO_BUDGET
+static long long budgetsteps;		// limits of every request, 0 - unlimited
+static int budgetms;
+#  endif
+static volatile sig_atomic_t stopping;
+#endif
+
+#ifdef FORTH_STATIC_APP
+#  include "app_image.h"
+#endif
+
+#ifdef FORTH_NO_OUTPUT
+#  define fth_emit(c)		putchar(c)
+#  define fth_type(s, len)	fwrite((s), 1, (len), stdout)
+#  define fth_typenumber(x, base) printf((base) == 10 ? "%d" : "%X", (x))
+#  define fth_flush()		fflush(stdout)
+#endif
+
+#ifndef FORTH_NO_SAVES
+#  define IMAGE_USAGE		" [-i image]"
+#else
+#  define IMAGE_USAGE		""
+#endif
+
+
+enum app_codes {
+	BYE,
+	DOT,
+	DOTX,
+	EMIT,
+	PRINT,
+	CR,
+	CLOCK,
+	DOTQUOTE,
+	DOTPROFILE,
+	DOTSTATS,
+	NANOTIME,
+	CYCLES,
+	DDOT,
+	TIMEIT,
+	
+	APP_PRIM_MAX
+};
+
+
+// Formatted output through the output layer
+static void typef(const char *fmt, ...)
+{
+	char buf[256];
+	va_list args;
+	int n;
+	
+	va_start(args, fmt);
+	n = vsnprintf(buf, sizeof(buf), fmt, args);
+	va_end(args);
+	fth_type(buf, n < (int)sizeof(buf) ? n : (int)sizeof(buf) - 1);
+}
+
+
+static void bye(void *udata)
+{
+#ifdef SERVER
+	if (serving) {			// ends the request, not the worker
+		byerequested = 1;
+		fth_error("BYE");
+	}
+#endif
+	fth_flush();
+	exit(EXIT_SUCCESS);
+}
+
+
+static void dot(void *udata)
+{
+	fth_typenumber(fth_pop(), 10);
+	fth_emit(' ');
+}
+
+
+static void dotx(void *udata)
+{
+	fth_typenumber(fth_pop(), 16);
+	fth_emit(' ');
+}
+
+
+static void emit(void *udata)
+{
+	fth_emit(fth_pop());
+}
+
+
+static void print(void *udata)
+{
+	int a = fth_pop(), length = fth_length(a);
+	
+	fth_type(fth_area(a, length), length);
+}
+
+
+static void cr(void *udata)
+{
+	fth_emit('\n');
+}
+
+
+static void clock_(void *udata)
+{
+	fth_push(clock());
+}
+
+
+static void nanotime(void *udata)
+{
+	long long t = fth_nanotime();
+	
+	fth_push((int)t);
+	fth_push((int)(t >> 32));
+}
+
+
+static void cycles(void *udata)
+{
+	long long t;
+	
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	unsigned lo, hi;
+	
+	__asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+	t = (long long)((unsigned long long)hi << 32 | lo);
+#elif defined(__GNUC__) && defined(__aarch64__)
+	__asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(t));
+#else
+	t = fth_nanotime();
+#endif
+	fth_push((int)t);
+	fth_push((int)(t >> 32));
+}
+
+
+static void ddot(void *udata)
+{
+	int hi = fth_pop();
+	unsigned lo = fth_pop();
+	char buf[32];
+	
+	fth_type(buf, snprintf(buf, sizeof(buf), "%lld ", (long long)((unsigned long long)(unsigned)hi << 32 | lo)));
+}
+
+
+static int cmptime(const void *a, const void *b)
+{
+	long long x = *(const long long *)a, y = *(const long long *)b;
+	
+	return x < y ? -1 : x > y;
+}
+
+
+// Runs xt n times and prints min/median/max times of a single run; the cost
+// of reading the clock and calling a word that does almost nothing (DEPTH) is
+// measured beforehand and subtracted
+static void timeit(void *udata)
+{
+	int n = fth_pop(), xt = fth_pop(), depth = fth_lookup("DEPTH"), i, r;
+	long long *samples, overhead = -1, t;
+	char msg[256];
+	
+	if (n <= 0)
+		fth_error("run count must be positive");
+	samples = (long long *)malloc(n * sizeof(long long));
+	if (!samples)
+		fth_error("unable to allocate memory for samples");
+	
+	for (i = 0; i < 1000; i++) {
+		t = fth_nanotime();
+		if (depth)
+			fth_call(depth, NULL, 0, &r, 1);
+		t = fth_nanotime() - t;
+		if (overhead < 0 || t < overhead)
+			overhead = t;
+	}
+	
+	for (i = 0; i < n; i++) {
+		t = fth_nanotime();
+		if (!fth_call(xt, NULL, 0, NULL, 0)) {
+			free(samples);
+			snprintf(msg, sizeof(msg), "%s", fth_geterror());
+			fth_error("%s", msg);
+		}
+		t = fth_nanotime() - t - overhead;
+		samples[i] = t > 0 ? t : 0;
+	}
+	
+	qsort(samples, n, sizeof(long long), cmptime);
+	typef("min %lld ns, median %lld ns, max %lld ns (%d runs, overhead %lld ns)\n",
+		samples[0], samples[n / 2], samples[n - 1], n, overhead);
+	free(samples);
+}
+
+
+static void dotquote(void *udata)
+{
+	fth_execute("\"");
+	fth_interpret("PRINT");
+}
+
+
+#ifndef FORTH_NO_PROFILER
+static void dotprofile(void *udata)
+{
+	profile_entry_t *entries;
+	char unnamed[32];
+	int n, i;
+	
+	n = fth_getprofile(NULL, 0);
+	entries = (profile_entry_t *)malloc((n + 1) * sizeof(profile_entry_t));
+	if (!entries)
+		fth_error("unable to allocate memory for profile");
+	n = fth_getprofile(entries, n);
+	
+	typef("%-24s %12s %12s %12s\n", "Word", "Calls", "Incl, ms", "Excl, ms");
+	for (i = 0; i < n; i++) {
+		const char *name = entries[i].name;
+		
+		if (!name) {
+			snprintf(unnamed, sizeof(unnamed), "<xt %d>", entries[i].xt);
+			name = unnamed;
+		}
+		typef("%-24s ", name);
+		if (entries[i].primitive)
+			typef("%12lld %12s %12s\n", entries[i].calls, "-", "-");
+		else
+			typef("%12lld %12.3f %12.3f\n", entries[i].calls, entries[i].inclusive / 1e6, entries[i].exclusive / 1e6);
+	}
+	free(entries);
+}
+#endif
+
+
+static void dotstats(void *udata)
+{
+	forth_stats_t st;
+	
+	fth_getstats(&st);
+	typef("%-16s %10s %10s %10s\n", "Area", "Current", "Peak", "Size");
+	typef("%-16s %10d %10d %10d\n", "Data stack", st.sp, st.sppeak, st.stacksize);
+	typef("%-16s %10d %10d %10d\n", "Return stack", st.rsp, st.rsppeak, st.rstacksize);
+	typef("%-16s %10d %10d %10d\n", "Loop stack", st.lsp, st.lsppeak, st.lstacksize);
+	typef("%-16s %10d %10d %10d\n", "Control stack", st.cfsp, st.cfsppeak, st.cfstacksize);
+	typef("%-16s %10d %10d %10d\n", "Code, cells", st.cp, st.cppeak, st.codecap);
+	typef("%-16s %10d %10d %10d\n", "Data, bytes", st.dp, st.dppeak, st.datacap);
+	typef("%-16s %10d %10d %10d\n", "Dictionary", st.dictp, st.dictppeak, st.dictcap);
+	typef("%-16s %10d %10d %10d\n", "Names, bytes", st.namesp, st.namesppeak, st.namescap);
+	typef("Reallocations: %lld (%lld bytes moved)\n", st.reallocs, st.copied);
+	typef("Errors: %lld raised, %lld caught by TRY\n", st.errors, st.caught);
+}
+
+
+primitive_func_t app_words[] = {
+	{"BYE",			BYE,		bye,		NULL,	0},
+	{".",			DOT,		dot,		NULL,	0},
+	{".X",			DOTX,		dotx,		NULL,	0},
+	{"EMIT",		EMIT,		emit,		NULL,	0},
+	{"PRINT",		PRINT,		print,		NULL,	0},
+	{"CR",			CR,		cr,		NULL,	0},
+	{"CLOCK",		CLOCK,		clock_,		NULL,	0},
+	{".\"",			DOTQUOTE,	dotquote,	NULL,	1},
+	{".STATS",		DOTSTATS,	dotstats,	NULL,	0},
+#ifndef FORTH_NO_PROFILER
+	{".PROFILE",		DOTPROFILE,	dotprofile,	NULL,	0},
+#endif
+	{"NANOTIME",		NANOTIME,	nanotime,	NULL,	0},
+	{"CYCLES",		CYCLES,		cycles,		NULL,	0},
+	{"D.",			DDOT,		ddot,		NULL,	0},
+	{"TIME-IT",		TIMEIT,		timeit,		NULL,	0},
+		
+	{NULL,			0,		NULL,		NULL,	0}
+};
+
+
+#ifdef FORTH_MKIMAGE
+// Generates precomputed core and application dictionaries at build time
+int main(int argc, char *argv[])
+{
+	if (argc < 3) {
+		fprintf(stderr, "Usage: %s core_image.h app_image.h\n", argv[0]);
+		return 1;
+	}
+	
+	fth_init(NULL, NULL);
+	fth_saveimage(argv[1], "core_image");
+	fth_libraryfunc(app_words);
+	fth_saveimage(argv[2], "app_image");
+	return 0;
+}
+#else
+// Prints error message, position in source and traceback
+static void printerror(FILE *f, const char *source)
+{
+	int lineno, linelen, intp, i;
+	const char *errline;
+	
+	fprintf(f, "Error: %s\n", fth_geterror());
+	errline = fth_geterrorline(&linelen, &intp, &lineno);
+	fprintf(f, "%s:%d\n", source, lineno);
+	fprintf(f, "%.*s\n", linelen, errline);
+	fprintf(f, "%*s\n", intp + 1, "^");
+	
+	if (fth_gettracedepth() > 0) {
+		fprintf(f, "Traceback:\n");
+		for (i = fth_gettracedepth() - 1; i >= 0; i--) {
+			fprintf(f, "\t%s\n", fth_gettrace(i));
+		}
+	}
+	
+	fprintf(f, "Stack: ");
+	for (i = 0; i < fth_getdepth(); i++)
+		fprintf(f, "%d ", fth_getstack(i));
+	if (i == 0)
+		fprintf(f, "empty");
+	fprintf(f, "\n");
+}
+
+
+#ifdef SERVER
+// ================================== Server ===================================
+
+static void append(buffer_t *b, const char *s, int len)
+{
+	if (b->len + len > b->cap) {
+		int cap = b->cap ? b->cap : 4096;
+		char *p;
+		
+		while (cap < b->len + len)
+			cap *= 2;
+		p = (char *)realloc(b->s, cap);
+		if (!p)
+			return;			// output is truncated
+		b->s = p;
+		b->cap = cap;
+	}
+	memcpy(b->s + b->len, s, len);
+	b->len += len;
+}
+
+
+static void capture(const char *s, int len, void *udata)
+{
+	append((buffer_t *)udata, s, len);
+}
+
+
+// Returns next byte from the connection or -1 at the end of it
+static int readbyte(reader_t *r)
+{
+	if (r->pos == r->len) {
+		do
+			r->len = read(r->fd, r->buf, sizeof(r->buf));
+		while (r->len < 0 && errno == EINTR);
+		r->pos = 0;
+		if (r->len <= 0) {
+			r->len = 0;
+			return -1;
+		}
+	}
+	return (unsigned char)r->buf[r->pos++];
+}
+
+
+static int readbytes(reader_t *r, char *s, int n)
+{
+	int k = r->len - r->pos < n ? r->len - r->pos : n;
+	
+	memcpy(s, r->buf + r->pos, k);
+	r->pos += k;
+	while (k < n) {
+		int got = read(r->fd, s + k, n - k);
+		
+		if (got < 0 && errno == EINTR)
+			continue;
+		if (got <= 0)
+			return 0;
+		k += got;
+	}
+	return 1;
+}
+
+
+static int writeall(int fd, const char *s, int n)
+{
+	while (n > 0) {
+		int put = write(fd, s, n);
+		
+		if (put < 0 && errno == EINTR)
+			continue;
+		if (put <= 0)
+			return 0;
+		s += put;
+		n -= put;
+	}
+	return 1;
+}
+
+
+// Serves requests of a connection until it is closed. A request is a line
+// "length [entry]" followed by length bytes of the script, a response is a line
+// "OK|ERROR latency length" followed by length bytes of the output. After every
+// request the system is restored from the checkpoint, returns 0 if it is lost
+static int serve(int fd)
+{
+	reader_t r;
+	buffer_t out = {NULL, 0, 0};
+	char header[256], entry[128], *script;
+	int length, ok, c, i, restored = 1;
+	long long start;
+	
+	r.fd = fd;
+	r.pos = r.len = 0;
+	fth_setoutput(capture, &out, FORTH_FLUSH_FULL);
+	
+	for (;;) {
+		for (i = 0; (c = readbyte(&r)) >= 0 && c != '\n'; )
+			if (i < (int)sizeof(header) - 1)
+				header[i++] = c;
+		if (c < 0)
+			break;
+		header[i] = 0;
+		entry[0] = 0;
+		if (sscanf(header, "%d %127s", &length, entry) < 1 || length < 0 || length > REQUEST_MAX)
+			break;
+		script = (char *)malloc(length + 1);
+		if (!script)
+			break;
+		if (!readbytes(&r, script, length)) {
+			free(script);
+			break;
+		}
+		script[length] = 0;
+		
+		out.len = 0;
+		byerequested = 0;
+#  ifndef FORTH_NO_BUDGET
+		fth_setbudget(budgetsteps, budgetms);
+#  endif
+		start = fth_nanotime();
+		ok = fth_interpret(script) && (!entry[0] || fth_execute(entry));
+		fth_flush();
+		if (!ok && byerequested) {
+			ok = 1;
+		} else if (!ok) {
+			char *report;
+			size_t size;
+			FILE *f = open_memstream(&report, &size);
+			
+			if (f) {
+				printerror(f, "<request>");
+				fclose(f);
+				append(&out, report, size);
+				free(report);
+			}
+		}
+		i = snprintf(header, sizeof(header), "%s %lld %d\n", ok ? "OK" : "ERROR", fth_nanotime() - start, out.len);
+		free(script);
+		if (!writeall(fd, header, i) || !writeall(fd, out.s, out.len))
+			break;
+		
+		restored = fth_restore();	// off the critical path: the response is already sent
+		if (!restored)
+			break;
+	}
+	
+	fth_setoutput(NULL, NULL, FORTH_FLUSH_LINE);
+	free(out.s);
+	return restored && fth_restore();
+}
+
+
+// Serves connections, starting every request from the state the worker was forked with;
+// exits if a request has replaced the whole system (LOAD), so a pristine worker is forked
+static void worker(int listener)
+{
+	int fd;
+	
+	signal(SIGTERM, SIG_DFL);
+	signal(SIGINT, SIG_DFL);
+	signal(SIGPIPE, SIG_IGN);
+	serving = 1;
+	if (!fth_checkpoint()) {
+		fprintf(stderr, "Unable to create checkpoint\n");
+		exit(EXIT_FAILURE);
+	}
+	for (;;) {
+		fd = accept(listener, NULL, NULL);
+		if (fd < 0) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			perror("accept");
+			exit(EXIT_FAILURE);
+		}
+		if (!serve(fd)) {
+			close(fd);
+			exit(EXIT_SUCCESS);
+		}
+		close(fd);
+	}
+}
+
+
+static void stop(int sig)
+{
+	stopping = 1;
+}
+
+
+// Listens on the socket and keeps the pool of workers forked from the preloaded
+// system, restarting the ones that exit
+static int server(const char *path, int nworkers)
+{
+	struct sockaddr_un addr;
+	struct sigaction sa;
+	pid_t *pids;
+	int listener, fd, status, i;
+	
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "Socket path is too long: %s\n", path);
+		return 1;
+	}
+	fth_reset();
+	
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	unlink(path);
+	if (listener < 0 || bind(listener, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(listener, SOMAXCONN) < 0) {
+		perror(path);
+		return 1;
+	}
+	
+	pids = (pid_t *)calloc(nworkers, sizeof(pid_t));
+	if (!pids) {
+		perror("Unable to allocate workers");
+		return 1;
+	}
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = stop;			// no SA_RESTART: wait() returns on the signal
+	sigaction(SIGTERM, &sa, NULL);
+	sigaction(SIGINT, &sa, NULL);
+	
+	fflush(stdout);
+	while (!stopping) {
+		for (i = 0; i < nworkers; i++)
+			if (!pids[i]) {
+				pids[i] = fork();
+				if (pids[i] == 0)
+					worker(listener);
+				if (pids[i] < 0) {
+					perror("fork");
+					pids[i] = 0;
+				}
+			}
+		
+		fd = wait(&status);
+		if (fd < 0 && errno != EINTR)
+			sleep(1);
+		for (i = 0; i < nworkers; i++)
+			if (fd > 0 && pids[i] == fd) {
+				fprintf(stderr, "Worker %d exited with status %d, restarting\n", fd, status);
+				pids[i] = 0;
+			}
+	}
+	
+	for (i = 0; i < nworkers; i++)
+		if (pids[i] > 0)
+			kill(pids[i], SIGTERM);
+	while (wait(&status) > 0 || errno == EINTR)
+		;
+	close(listener);
+	unlink(path);
+	free(pids);
+	return 0;
+}
+#endif
+
+
+int main(int argc, char *argv[])
+{
+	const char *fname = NULL;
+#ifndef FORTH_NO_SAVES
+	const char *image = NULL;
+#endif
+#ifdef SERVER
+	const char *sockname = NULL;
+	int workers = WORKERS_DEFAULT;
+#endif
+	char tib[256];
+	int i;
+	
+	for (i = 1; i < argc; i++) {
+#ifndef FORTH_NO_SAVES
+		if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
+			image = argv[++i];
+		} else
+#endif
+#ifdef SERVER
+		if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+			sockname = argv[++i];
+		} else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+			workers = atoi(argv[++i]);
+#  ifndef FORTH_NO_BUDGET
+		} else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+			budgetsteps = atoll(argv[++i]);
+		} else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+			budgetms = atoi(argv[++i]);
+#  endif
+		} else
+#endif
+		if (argv[i][0] != '-' && !fname) {
+			fname = argv[i];
+		} else {
+#ifdef SERVER
+			fprintf(stderr, "Usage: %s" IMAGE_USAGE " [-s socket [-w workers] [-b steps] [-t ms]] [file]\n", argv[0]);
+#else
+			fprintf(stderr, "Usage: %s" IMAGE_USAGE " [file]\n", argv[0]);
+#endif
+			return 1;
+		}
+	}
+	
+#ifdef FORTH_STATIC_APP
+	fth_initimage(&app_image, NULL, NULL);
+	fth_bindlibrary(app_words);
+#else
+	fth_init(NULL, NULL);
+	fth_libraryfunc(app_words);
+#endif
+	
+#ifndef FORTH_NO_SAVES
+	if (image) {
+		struct stat st;
+		char *load;
+		int n;
+		
+		if (stat(image, &st) != 0) {
+			perror(image);
+			return 1;
+		}
+		if (strchr(image, '"')) {
+			fprintf(stderr, "%s: image name can't contain '\"'\n", image);
+			return 1;
+		}
+		
+		// loaded by LOAD, so errors in the file are reported instead of aborting
+		load = (char *)malloc(2 * strlen(image) + 16);
+		if (!load) {
+			perror("Unable to allocate memory for image name");
+			return 1;
+		}
+		n = sprintf(load, "\" ");
+		for (i = 0; image[i]; i++) {
+			if (image[i] == '\\')
+				load[n++] = '\\';
+			load[n++] = image[i];
+		}
+		strcpy(&load[n], "\" LOAD");
+		if (!fth_interpret(load)) {
+			printerror(stderr, image);
+			free(load);
+			return 1;
+		}
+		free(load);
+	}
+#endif
+	
+	if (fname) {
+		FILE *f;
+		struct stat st;
+		char *source;
+		int read;
+		
+		if (stat(fname, &st) != 0) {
+			perror(fname);
+			return 1;
+		}
+		
+		source = (char *)malloc(st.st_size + 1);
+		if (!source) {
+			perror("Unable to allocate memory for file contents");
+			return 1;
+		}
+		
+		f = fopen(fname, "r");
+		if (!f) {
+			perror(fname);
+			free(source);
+			return 1;
+		}
+		
+		read = fread(source, 1, st.st_size, f);
+		fclose(f);
+		source[read] = 0;
+		
+		if (fth_interpret(source)) {
+			fth_flush();
+			free(source);
+#ifdef SERVER
+			if (sockname)
+				return server(sockname, workers > 0 ? workers : WORKERS_DEFAULT);
+#endif
+			return 0;
+		} else {
+			fth_flush();
+			printerror(stderr, fname);
+			fth_reset();
+			free(source);
+#ifdef SERVER
+			if (sockname)
+				return 1;
+#endif
+		}
+	}
+	
+#ifdef SERVER
+	if (sockname)
+		return server(sockname, workers > 0 ? workers : WORKERS_DEFAULT);
+#endif
+	
+	while (fgets(tib, 256, stdin))
+		if (strlen(tib) > 1) {
+			if (fth_interpret(tib)) {
+				fth_flush();
+				if (!fth_getstate())
+					printf(" OK\n");
+			} else {
+				fth_flush();
+				printerror(stderr, "<stdin>");
+				fth_reset();
+			}
+		}
+	
+	return 0;
+}
+
+#endif